@@ -0,0 +1,35 @@
+// host build of the per-sample kernel benchmark (the same cases as `bench ops` on the device)
+//
+//   kernel_bench [--min-ms N] > results.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "kernel_bench.hpp"
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int main(int argc, char** argv) {
+  uint64_t min_duration_ns = 20 * 1000 * 1000;
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--min-ms") && a + 1 < argc) {
+      min_duration_ns = strtoull(argv[++a], nullptr, 10) * 1000 * 1000;
+    } else {
+      fprintf(stderr, "usage: %s [--min-ms N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("%s\n", KERNEL_BENCH_CSV_HEADER);
+  for (size_t idx = 0; idx < kernel_bench_num_cases(); idx++) {
+    kernel_bench_result r = kernel_bench_run(idx, now_ns, min_duration_ns);
+    printf("%s,%u,%u,%u,%.1f,%.3f\n", r.kernel, r.sensors, r.window, r.reps, r.ns_per_window(), r.ns_per_sample());
+  }
+  return 0;
+}
@@ -0,0 +1,570 @@
+// replays recorded or synthetic sensor traces through the firmware's running_stats, sliding window, filter, fusion and
+// debounce code, and checks the resulting button events against golden files.
+//
+//   replay_tests --golden DIR [--update] [--tolerance-us N] [--dump-traces DIR] [TRACE_FILE...]
+//
+// trace files (written by --dump-traces, or recorded) are plain text:
+//   period_us 40
+//   truth 200000 UU press        (optional, the real presses, for latency and false/missed events)
+//   truth none                    (instead, for a recording without any presses)
+//   v0 v1 ... v7                  (one line per round over all sensors, raw counts)
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "config_values.hpp"
+#include "running_stats.hpp"
+#include "sensor_health.hpp"
+#include "sliding_window.hpp"
+#include "touch_decision.hpp"
+#include "touch_sensor_config.hpp"
+#include "touch_sensor_thread.hpp"
+
+// normally defined by the sampling thread and the health monitor, which don't run here
+uint16_t touch_sensor_thresholds[num_touch_sensors] = {0};
+float touch_sensor_baseline[num_touch_sensors] = {0};
+float touch_sensor_noise[num_touch_sensors] = {0};
+float touch_sensor_drift[num_touch_sensors] = {0};
+volatile uint8_t sensor_health_faults[num_touch_sensors] = {0};
+
+constexpr value_t touch_timeout = 1 << 12;
+// the start of every trace is idle, and used as the baseline (like calibrate_touch_sensors)
+constexpr uint64_t calibration_us = 100 * 1000;
+
+struct button_event {
+  uint64_t t_us;
+  game_button button;
+  bool pressed;
+};
+
+struct trace {
+  std::string name;
+  uint64_t period_us = 40;
+  std::vector<std::array<value_t, num_touch_sensors>> rounds;
+  std::vector<button_event> truth;
+  // the truth is known (possibly no presses at all), so every missed or extra event is a failure
+  bool has_truth = false;
+};
+
+struct filter_case {
+  int type;
+  const char* name;
+};
+static const filter_case filter_cases[] = {
+    {FILTER_TYPE_MEDIAN, "median"},
+    {FILTER_TYPE_AVG, "avg"},
+    {FILTER_TYPE_IIR, "iir"},
+    {FILTER_TYPE_SPRT, "sprt"},
+    {FILTER_TYPE_KALMAN, "kalman"},
+};
+
+// false events that are a known weakness of a filter rather than a regression. the count has to match exactly, so a
+// fix shows up here too
+struct known_false_events {
+  const char* trace;
+  const char* filter;
+  uint spurious;
+  const char* reason;
+};
+static const known_false_events known_false_events_list[] = {
+    {"noisy_idle", "iir", 2,
+     "iir_filter_b 0.8 mostly follows the last sample, so a spike at the end of a sub-window presses for a debounce"},
+};
+
+static uint allowed_spurious(const std::string& trace_name, const char* filter_name, const char** reason) {
+  for (const known_false_events& k : known_false_events_list) {
+    if (trace_name == k.trace && strcmp(filter_name, k.filter) == 0) {
+      *reason = k.reason;
+      return k.spurious;
+    }
+  }
+  *reason = nullptr;
+  return 0;
+}
+
+static game_button button_from_label(const std::string& label) {
+  for (int b = 0; b < NUM_GAME_BUTTONS; b++) {
+    if (label == game_button_short_labels[b]) {
+      return (game_button)b;
+    }
+  }
+  return INVALID;
+}
+
+static std::string format_event(const button_event& e) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%llu %s %s", (unsigned long long)e.t_us, game_button_short_labels[e.button],
+           e.pressed ? "press" : "release");
+  return buf;
+}
+
+static bool parse_event(const std::string& line, button_event& e) {
+  std::istringstream in(line);
+  unsigned long long t;
+  std::string label, type;
+  if (!(in >> t >> label >> type)) {
+    return false;
+  }
+  e = {t, button_from_label(label), type == "press"};
+  return e.button != INVALID;
+}
+
+#pragma region synthetic traces
+
+// deterministic, so the golden files don't depend on the platform's rand()
+struct xorshift {
+  uint32_t state;
+  uint32_t next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+  float gaussian() {
+    float u1 = MAX(uniform(), 1e-7f);
+    float u2 = uniform();
+    return sqrtf(-2 * logf(u1)) * cosf(2 * (float)M_PI * u2);
+  }
+};
+
+struct press {
+  game_button button;
+  uint64_t start_us;
+  uint64_t end_us;
+  // how much of each sensor of the button the foot covers
+  float coverage[2] = {1, 1};
+};
+
+struct synth_params {
+  float noise = 8;
+  float amplitude = 400;
+  float rise_us = 2000;
+  float fall_us = 3000;
+  float hum_amplitude = 0;
+  float hum_hz = 50;
+  // fraction of each sensor's touch signal that leaks into every other sensor
+  float crosstalk[num_touch_sensors][num_touch_sensors] = {};
+  uint num_spikes = 0;
+};
+
+// first-order response of the electrode to a foot arriving at start_us and leaving at end_us
+static float touch_signal(const synth_params& p, const press& pr, uint64_t t) {
+  if (t < pr.start_us) {
+    return 0;
+  }
+  float on = 1 - expf(-(float)(MIN(t, pr.end_us) - pr.start_us) / p.rise_us);
+  if (t < pr.end_us) {
+    return on;
+  }
+  return on * expf(-(float)(t - pr.end_us) / p.fall_us);
+}
+
+static trace synthesize(const std::string& name, uint64_t duration_us, const std::vector<press>& presses,
+                        const synth_params& p, uint32_t seed) {
+  trace tr;
+  tr.name = name;
+  xorshift rng = {seed};
+  uint n = duration_us / tr.period_us;
+  std::vector<uint> spikes;
+  for (uint k = 0; k < p.num_spikes; k++) {
+    spikes.push_back(calibration_us / tr.period_us + rng.next() % (n - calibration_us / tr.period_us));
+  }
+  for (uint k = 0; k < n; k++) {
+    uint64_t t = (uint64_t)k * tr.period_us;
+    float signal[num_touch_sensors] = {0};
+    for (const press& pr : presses) {
+      uint j = 0;
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        if (touch_sensor_configs[i].button == pr.button) {
+          signal[i] += p.amplitude * pr.coverage[MIN(j, 1u)] * touch_signal(p, pr, t);
+          j++;
+        }
+      }
+    }
+    float leaked[num_touch_sensors];
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      leaked[i] = signal[i];
+      for (uint j = 0; j < num_touch_sensors; j++) {
+        leaked[i] += p.crosstalk[j][i] * signal[j];
+      }
+    }
+    float hum = p.hum_amplitude * sinf(2 * (float)M_PI * p.hum_hz * t * 1e-6f);
+    bool spike = std::find(spikes.begin(), spikes.end(), k) != spikes.end();
+    std::array<value_t, num_touch_sensors> round;
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      float v = 900 + 20 * i + leaked[i] + hum + p.noise * rng.gaussian();
+      if (spike && i == 0) {
+        v += 800;
+      }
+      round[i] = (value_t)MIN(MAX(lroundf(v), 1), touch_timeout - 1);
+    }
+    tr.rounds.push_back(round);
+  }
+  for (const press& pr : presses) {
+    tr.truth.push_back({pr.start_us, pr.button, true});
+    tr.truth.push_back({pr.end_us, pr.button, false});
+  }
+  std::stable_sort(tr.truth.begin(), tr.truth.end(),
+                   [](const button_event& a, const button_event& b) { return a.t_us < b.t_us; });
+  tr.has_truth = true;
+  return tr;
+}
+
+static std::vector<trace> synthetic_traces() {
+  std::vector<trace> traces;
+  const uint64_t ms = 1000;
+
+  traces.push_back(synthesize("single_tap", 500 * ms, {{UP, 200 * ms, 350 * ms}}, synth_params(), 1));
+
+  // alternating left/right, each press overlapping the next a little
+  std::vector<press> jacks;
+  for (uint k = 0; k < 8; k++) {
+    uint64_t start = 200 * ms + k * 50 * ms;
+    jacks.push_back({k % 2 ? RIGHT : LEFT, start, start + 60 * ms});
+  }
+  traces.push_back(synthesize("fast_jacks", 750 * ms, jacks, synth_params(), 2));
+
+  // heel held on DOWN while the toe taps RIGHT twice. the heel only half covers one sensor, and the two panels leak
+  // into each other where they meet (sensors D and E)
+  synth_params heel_toe;
+  heel_toe.crosstalk[3][4] = 0.2f;
+  heel_toe.crosstalk[4][3] = 0.2f;
+  press heel = {DOWN, 200 * ms, 420 * ms};
+  heel.coverage[1] = 0.5f;
+  traces.push_back(
+      synthesize("heel_toe", 600 * ms, {heel, {RIGHT, 260 * ms, 340 * ms}, {RIGHT, 380 * ms, 460 * ms}}, heel_toe, 3));
+
+  synth_params noisy;
+  noisy.noise = 25;
+  noisy.num_spikes = 5;
+  traces.push_back(synthesize("noisy_idle", 1000 * ms, {}, noisy, 4));
+
+  synth_params hum;
+  hum.hum_amplitude = 80;
+  traces.push_back(synthesize("mains_hum", 600 * ms, {{LEFT, 300 * ms, 450 * ms}}, hum, 5));
+
+  return traces;
+}
+
+#pragma endregion synthetic traces
+
+#pragma region trace files
+
+static bool load_trace(const std::string& path, trace& tr) {
+  std::ifstream in(path);
+  if (!in) {
+    return false;
+  }
+  size_t slash = path.find_last_of('/');
+  tr.name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+  tr.name = tr.name.substr(0, tr.name.find('.'));
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    } else if (line.rfind("period_us ", 0) == 0) {
+      tr.period_us = strtoull(line.c_str() + 10, nullptr, 10);
+    } else if (line == "truth none") {
+      tr.has_truth = true;
+    } else if (line.rfind("truth ", 0) == 0) {
+      tr.has_truth = true;
+      button_event e;
+      if (parse_event(line.substr(6), e)) {
+        tr.truth.push_back(e);
+      }
+    } else {
+      std::istringstream values(line);
+      std::array<value_t, num_touch_sensors> round;
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        int v = 0;
+        values >> v;
+        round[i] = v;
+      }
+      tr.rounds.push_back(round);
+    }
+  }
+  return !tr.rounds.empty();
+}
+
+static void dump_trace(const std::string& dir, const trace& tr) {
+  std::ofstream out(dir + "/" + tr.name + ".trace");
+  out << "# " << tr.name << "\n";
+  out << "period_us " << tr.period_us << "\n";
+  if (tr.has_truth && tr.truth.empty()) {
+    out << "truth none\n";
+  }
+  for (const button_event& e : tr.truth) {
+    out << "truth " << format_event(e) << "\n";
+  }
+  for (const auto& round : tr.rounds) {
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      out << (i ? " " : "") << round[i];
+    }
+    out << "\n";
+  }
+}
+
+#pragma endregion trace files
+
+// same steps as run_touch_sensor_thread, minus the hardware: calibrate, then sub-windows through the sliding window and
+// the decision code. events are timestamped with the last sample of the window they were decided on
+static std::vector<button_event> replay(const trace& tr) {
+  reset_touch_decisions();
+
+  uint calibration_rounds = MIN(calibration_us / tr.period_us, tr.rounds.size());
+  std::array<running_stats, num_touch_sensors> chunks[calibration_chunks];
+  for (uint k = 0; k < calibration_rounds; k++) {
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      chunks[k * calibration_chunks / calibration_rounds][i].add_value(tr.rounds[k][i]);
+    }
+  }
+  calibrate_from_chunks(chunks);
+  update_touch_thresholds();
+
+  sliding_window window;
+  uint num_subwindows = sliding_window::num_subwindows(sampling_duration_us);
+  window.resize(num_subwindows);
+  const uint64_t subwindow_us = sampling_duration_us / num_subwindows;
+  std::array<running_stats, num_touch_sensors> by_sensor;
+
+  std::vector<button_event> events;
+  uint32_t prev_active_buttons = 0;
+  uint k = calibration_rounds;
+  while (k < tr.rounds.size()) {
+    uint64_t end_us = (uint64_t)k * tr.period_us + subwindow_us;
+    std::array<running_stats, num_touch_sensors>& subwindow = window.next_subwindow();
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      subwindow[i].start_window(sampling_threshold(i));
+    }
+    uint64_t last_sample_us = 0;
+    // like the sampling loop, SPRT ends the sub-window after the round where a decision changed
+    bool decision_changed = false;
+    for (; k < tr.rounds.size() && (uint64_t)k * tr.period_us < end_us && !decision_changed; k++) {
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        subwindow[i].add_value(tr.rounds[k][i]);
+        decision_changed |= sample_filters_add_value(subwindow[i], i, tr.rounds[k][i], filter_type);
+      }
+      last_sample_us = (uint64_t)k * tr.period_us;
+    }
+    if (subwindow[0].get_total_count() == 0) {
+      break;
+    }
+
+    window.commit();
+    window.merged(by_sensor, touch_sensor_thresholds);
+    uint32_t active_buttons = update_touch_decisions(by_sensor, last_sample_us);
+    for (int b = 0; b < NUM_GAME_BUTTONS; b++) {
+      if ((active_buttons ^ prev_active_buttons) & (1u << b)) {
+        events.push_back({last_sample_us, (game_button)b, (bool)(active_buttons & (1u << b))});
+      }
+    }
+    prev_active_buttons = active_buttons;
+  }
+  return events;
+}
+
+struct latency_summary {
+  std::vector<uint64_t> latencies_us;
+  uint missed = 0;
+  uint spurious = 0;
+};
+
+// match every real press/release with the first detected event of the same kind after it (and before the button's
+// next real transition)
+static void measure_latency(const trace& tr, const std::vector<button_event>& events, latency_summary& summary) {
+  std::vector<bool> used(events.size(), false);
+  for (size_t t = 0; t < tr.truth.size(); t++) {
+    const button_event& truth = tr.truth[t];
+    uint64_t until = UINT64_MAX;
+    for (size_t n = t + 1; n < tr.truth.size(); n++) {
+      if (tr.truth[n].button == truth.button) {
+        until = tr.truth[n].t_us;
+        break;
+      }
+    }
+    bool found = false;
+    for (size_t d = 0; d < events.size() && !found; d++) {
+      const button_event& e = events[d];
+      if (!used[d] && e.button == truth.button && e.pressed == truth.pressed && e.t_us >= truth.t_us &&
+          e.t_us < until) {
+        used[d] = true;
+        found = true;
+        summary.latencies_us.push_back(e.t_us - truth.t_us);
+      }
+    }
+    summary.missed += !found;
+  }
+  summary.spurious += std::count(used.begin(), used.end(), false);
+}
+
+static uint64_t percentile(std::vector<uint64_t> v, float p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t rank = (size_t)ceilf(p / 100 * v.size());
+  return v[MAX(rank, (size_t)1) - 1];
+}
+
+// returns false if the events are a regression from the golden file: different events, or any event detected later
+static bool check_golden(const std::string& path,
+                         const std::vector<button_event>& events,
+                         uint64_t tolerance_us,
+                         bool update) {
+  if (update) {
+    std::ofstream out(path);
+    for (const button_event& e : events) {
+      out << format_event(e) << "\n";
+    }
+    return true;
+  }
+
+  std::ifstream in(path);
+  if (!in) {
+    printf("  missing golden file %s (run with --update to create it)\n", path.c_str());
+    return false;
+  }
+  std::vector<button_event> golden;
+  std::string line;
+  while (std::getline(in, line)) {
+    button_event e;
+    if (parse_event(line, e)) {
+      golden.push_back(e);
+    }
+  }
+
+  bool ok = true;
+  for (size_t n = 0; n < MAX(golden.size(), events.size()); n++) {
+    if (n >= golden.size() || n >= events.size() || golden[n].button != events[n].button ||
+        golden[n].pressed != events[n].pressed) {
+      printf("  event %zu: expected '%s', got '%s'\n", n, n < golden.size() ? format_event(golden[n]).c_str() : "-",
+             n < events.size() ? format_event(events[n]).c_str() : "-");
+      ok = false;
+    } else if (events[n].t_us > golden[n].t_us + tolerance_us) {
+      printf("  event %zu: '%s' is %llu us later than golden\n", n, format_event(events[n]).c_str(),
+             (unsigned long long)(events[n].t_us - golden[n].t_us));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// when an adaptive window shrinks, sliding_window::clear() drops the older sub-windows, so the next merged() must be
+// exactly the sub-window sampled after it, wherever it sits in the ring
+static bool check_sliding_window_clear() {
+  sliding_window window;
+  window.resize(4);
+  // wrap around the ring once, so the next slot isn't the first one
+  for (value_t v = 100; v <= 500; v += 100) {
+    std::array<running_stats, num_touch_sensors>& subwindow = window.next_subwindow();
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      subwindow[i].start_window(touch_sensor_thresholds[i]);
+      subwindow[i].add_value(v);
+    }
+    window.commit();
+  }
+  window.clear();
+  std::array<running_stats, num_touch_sensors>& subwindow = window.next_subwindow();
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    subwindow[i].start_window(touch_sensor_thresholds[i]);
+    subwindow[i].add_value(900);
+  }
+  window.commit();
+
+  std::array<running_stats, num_touch_sensors> by_sensor;
+  window.merged(by_sensor, touch_sensor_thresholds);
+  bool ok = by_sensor[0].get_total_count() == 1 && by_sensor[0].get_mean() == 900;
+  printf("%-4s sliding window after clear: %u samples, mean %d\n", ok ? "ok" : "FAIL", by_sensor[0].get_total_count(),
+         by_sensor[0].get_total_count() ? by_sensor[0].get_mean() : 0);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  std::string golden_dir;
+  std::string dump_dir;
+  bool update = false;
+  uint64_t tolerance_us = 0;
+  std::vector<trace> traces = synthetic_traces();
+
+  for (int a = 1; a < argc; a++) {
+    std::string arg = argv[a];
+    if (arg == "--golden" && a + 1 < argc) {
+      golden_dir = argv[++a];
+    } else if (arg == "--update") {
+      update = true;
+    } else if (arg == "--tolerance-us" && a + 1 < argc) {
+      tolerance_us = strtoull(argv[++a], nullptr, 10);
+    } else if (arg == "--dump-traces" && a + 1 < argc) {
+      dump_dir = argv[++a];
+    } else {
+      trace tr;
+      if (!load_trace(arg, tr)) {
+        fprintf(stderr, "could not read trace %s\n", arg.c_str());
+        return 2;
+      }
+      traces.push_back(tr);
+    }
+  }
+  if (golden_dir.empty()) {
+    fprintf(stderr, "usage: %s --golden DIR [--update] [--tolerance-us N] [--dump-traces DIR] [TRACE_FILE...]\n",
+            argv[0]);
+    return 2;
+  }
+  if (!dump_dir.empty()) {
+    for (const trace& tr : traces) {
+      dump_trace(dump_dir, tr);
+    }
+  }
+
+  bool all_ok = check_sliding_window_clear();
+  latency_summary summaries[count_of(filter_cases)];
+  for (size_t f = 0; f < count_of(filter_cases); f++) {
+    filter_type = filter_cases[f].type;
+    for (const trace& tr : traces) {
+      std::vector<button_event> events = replay(tr);
+      latency_summary c;
+      measure_latency(tr, events, c);
+      summaries[f].latencies_us.insert(summaries[f].latencies_us.end(), c.latencies_us.begin(), c.latencies_us.end());
+      summaries[f].missed += c.missed;
+      summaries[f].spurious += c.spurious;
+
+      std::string path = golden_dir + "/" + tr.name + "." + filter_cases[f].name + ".txt";
+      bool ok = check_golden(path, events, tolerance_us, update);
+      // even --update doesn't make a missed or false event the expected output
+      const char* reason;
+      uint allowed = allowed_spurious(tr.name, filter_cases[f].name, &reason);
+      if (tr.has_truth && (c.missed || c.spurious != allowed)) {
+        printf("  %u missed, %u false events (expected 0 and %u)\n", c.missed, c.spurious, allowed);
+        ok = false;
+      } else if (tr.has_truth && allowed) {
+        printf("  %u known false events: %s\n", allowed, reason);
+      }
+      printf("%-4s %-12s %-7s %zu events\n", ok ? "ok" : "FAIL", tr.name.c_str(), filter_cases[f].name,
+             events.size());
+      all_ok &= ok;
+    }
+  }
+
+  printf("\ndetection latency over all traces (us, from the real press/release to the window it was decided in)\n");
+  printf("%-7s %7s %7s %7s %7s %7s %7s %7s\n", "filter", "events", "missed", "false", "p50", "p90", "p99", "max");
+  for (size_t f = 0; f < count_of(filter_cases); f++) {
+    const latency_summary& s = summaries[f];
+    printf("%-7s %7zu %7u %7u %7llu %7llu %7llu %7llu\n", filter_cases[f].name, s.latencies_us.size(), s.missed,
+           s.spurious, (unsigned long long)percentile(s.latencies_us, 50),
+           (unsigned long long)percentile(s.latencies_us, 90), (unsigned long long)percentile(s.latencies_us, 99),
+           (unsigned long long)percentile(s.latencies_us, 100));
+  }
+
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "pico/stdlib.h"
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
@@ -0,0 +1,14 @@
+#pragma once
+// host stand-in for the pico SDK's hardware/sync.h
+
+#include <atomic>
+
+static inline uint32_t save_and_disable_interrupts() {
+  return 0;
+}
+
+static inline void restore_interrupts(uint32_t) {}
+
+static inline void __dmb() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
@@ -0,0 +1,17 @@
+#pragma once
+// just enough of the pico SDK to build the decision code on a PC
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned int uint;
+
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#define __time_critical_func(func_name) func_name
+#define __not_in_flash_func(func_name) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
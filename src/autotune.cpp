@@ -0,0 +1,214 @@
+#include "tusb.h"
+
+#include "autotune.hpp"
+#include "config_defines.h"
+#include "custom_logging.hpp"
+#include "serial_config_console.hpp"
+#include "touch_decision.hpp"
+#include "touch_sensor_config.hpp"
+
+enum autotune_state {
+  AUTOTUNE_INACTIVE,
+  // waiting for the user to step off the pad
+  AUTOTUNE_WAIT_IDLE,
+  AUTOTUNE_RECORD_IDLE,
+  // waiting for the user to step on autotune_sensor_idx
+  AUTOTUNE_WAIT_PRESSED,
+  AUTOTUNE_RECORD_PRESSED,
+};
+
+static autotune_state state = AUTOTUNE_INACTIVE;
+static uint8_t autotune_itf;
+static uint autotune_sensor_idx = 0;
+static uint64_t record_start_us = 0;
+
+// distribution of the per-window mean of each sensor
+static mean_variance_accumulator idle_stats[num_touch_sensors];
+static mean_variance_accumulator pressed_stats[num_touch_sensors];
+// crosstalk_stats[j][i] is the distribution of sensor i while sensor j is pressed
+static mean_variance_accumulator crosstalk_stats[num_touch_sensors][num_touch_sensors];
+
+static void print_pressed_prompt() {
+  const touch_sensor_config_t& cfg = touch_sensor_configs[autotune_sensor_idx];
+  CDC_PRINTF(autotune_itf, "stand on sensor %u (button %s, pin %u) and press enter\r\n", autotune_sensor_idx,
+             game_button_short_labels[cfg.button], cfg.pin);
+  CDC_FLUSH(autotune_itf);
+}
+
+void autotune_start(uint8_t itf) {
+  autotune_itf = itf;
+  autotune_sensor_idx = 0;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    idle_stats[i].reset();
+    pressed_stats[i].reset();
+    for (uint j = 0; j < num_touch_sensors; j++) {
+      crosstalk_stats[i][j].reset();
+    }
+  }
+  state = AUTOTUNE_WAIT_IDLE;
+  CDC_PUTS(itf, "autotune: type 'cancel' at any prompt to abort");
+  CDC_PUTS(itf, "step off the pad and press enter");
+  CDC_FLUSH(itf);
+}
+
+bool autotune_is_active() {
+  return state != AUTOTUNE_INACTIVE;
+}
+
+void autotune_handle_line(uint8_t itf, std::string_view line) {
+  if (line.rfind("cancel") == 0) {
+    state = AUTOTUNE_INACTIVE;
+    CDC_PUTS(itf, "autotune cancelled, config unchanged");
+    return;
+  }
+  switch (state) {
+    case AUTOTUNE_WAIT_IDLE:
+      CDC_PUTS(itf, "recording idle values, don't touch the pad...");
+      record_start_us = time_us_64();
+      state = AUTOTUNE_RECORD_IDLE;
+      break;
+    case AUTOTUNE_WAIT_PRESSED:
+      CDC_PUTS(itf, "recording pressed values, keep standing on it...");
+      record_start_us = time_us_64();
+      state = AUTOTUNE_RECORD_PRESSED;
+      break;
+    default:
+      CDC_PUTS(itf, "still recording, please wait");
+      break;
+  }
+  CDC_FLUSH(itf);
+}
+
+void autotune_add_frame(const touchpad_stats_t& frame) {
+  switch (state) {
+    case AUTOTUNE_RECORD_IDLE:
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        idle_stats[i].add_value(frame.get_mean(i));
+      }
+      break;
+    case AUTOTUNE_RECORD_PRESSED:
+      pressed_stats[autotune_sensor_idx].add_value(frame.get_mean(autotune_sensor_idx));
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        crosstalk_stats[autotune_sensor_idx][i].add_value(frame.get_mean(i));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * picks the threshold and hysteresis for one sensor from its idle and pressed distributions.
+ *
+ * the lowest threshold that keeps false triggers rare (autotune_idle_sigmas above the idle mean) is detected earliest
+ * on the rising edge of a press, so that is preferred. if the distributions overlap too much for that, fall back to
+ * the point with equal z-score to both distributions, which maximizes the separation.
+ */
+static bool compute_sensor_thresholds(uint i, float& out_threshold_value, float& out_hysteresis, float& out_snr) {
+  const float idle_mean = idle_stats[i].mean;
+  const float pressed_mean = pressed_stats[i].mean;
+  // counts are integers, so the stddev of a window mean is never really 0
+  const float idle_stddev = MAX(idle_stats[i].get_stddev(), 1.0f);
+  const float pressed_stddev = MAX(pressed_stats[i].get_stddev(), 1.0f);
+  if (idle_stats[i].count < 2 || pressed_stats[i].count < 2 || pressed_mean <= idle_mean) {
+    return false;
+  }
+
+  float threshold_separation = (idle_mean * pressed_stddev + pressed_mean * idle_stddev) / (idle_stddev + pressed_stddev);
+  float threshold_fast = idle_mean + autotune_idle_sigmas * idle_stddev;
+  float threshold = MIN(threshold_fast, threshold_separation);
+
+  // release once the value is back within half of that margin of the idle distribution
+  float release_level = idle_mean + 0.5f * (threshold - idle_mean);
+
+  // thresholds are applied relative to the baseline measured at startup
+  out_threshold_value = threshold - idle_mean;
+  out_hysteresis = threshold - release_level;
+  out_snr = (pressed_mean - idle_mean) / idle_stddev;
+  return true;
+}
+
+/**
+ * crosstalk from sensor j into sensor i, as the shift of sensor i relative to the shift of sensor j while only j was
+ * pressed. sensors on the same button are combined anyway, so their crosstalk is left alone.
+ */
+static int compute_crosstalk(uint i, uint j) {
+  if (i == j || touch_sensor_configs[i].button == touch_sensor_configs[j].button) {
+    return 0;
+  }
+  float pressed_delta = pressed_stats[j].mean - idle_stats[j].mean;
+  if (pressed_stats[j].count < 2 || pressed_delta <= 0) {
+    return 0;
+  }
+  float ratio = (crosstalk_stats[j][i].mean - idle_stats[i].mean) / pressed_delta;
+  ratio = MAX(-1.0f, MIN(ratio, 1.0f));
+  return (int)roundf(ratio * (1 << CROSSTALK_FRACTION_BITS));
+}
+
+static void finish_autotune() {
+  const uint8_t itf = autotune_itf;
+  bool all_ok = true;
+  CDC_PUTS(itf, "sensor  btn  idle_mean  idle_sd  press_mean  press_sd  threshold_value  hysteresis  weight");
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    float new_threshold_value, new_hysteresis, snr;
+    bool ok = compute_sensor_thresholds(i, new_threshold_value, new_hysteresis, snr);
+    if (ok) {
+      threshold_value[i] = new_threshold_value;
+      hysteresis[i] = new_hysteresis;
+      fusion_weight[i] = snr;
+      sprt_press_delta[i] = pressed_stats[i].mean - idle_stats[i].mean;
+    }
+    all_ok = all_ok && ok;
+    CDC_PRINTF(itf, "%6u  %3s  %9.1f  %7.2f  %10.1f  %8.2f  %15.1f  %10.1f  %6.1f%s\r\n", i,
+               game_button_short_labels[touch_sensor_configs[i].button], idle_stats[i].mean,
+               idle_stats[i].get_stddev(), pressed_stats[i].mean, pressed_stats[i].get_stddev(), threshold_value[i],
+               hysteresis[i], fusion_weight[i], ok ? "" : "  (no separation, unchanged)");
+  }
+  threshold_type = THRESHOLD_TYPE_VALUE;
+  touch_filter_params_dirty = true;
+
+  CDC_PUTS(itf, "crosstalk (row: affected sensor, column: pressed sensor, 1/4096ths):");
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    for (uint j = 0; j < num_touch_sensors; j++) {
+      crosstalk[i * num_touch_sensors + j] = compute_crosstalk(i, j);
+      CDC_PRINTF(itf, "%6d", crosstalk[i * num_touch_sensors + j]);
+    }
+    CDC_PUTS(itf, "");
+  }
+
+  if (!all_ok) {
+    CDC_PUTS(itf, "warning: some sensors could not be tuned, check the wiring");
+  }
+  if (write_config_to_flash()) {
+    CDC_PUTS(itf, "saved to flash");
+  } else {
+    CDC_PUTS(itf, "failed to save to flash");
+  }
+  CDC_FLUSH(itf);
+}
+
+void autotune_task() {
+  if (state != AUTOTUNE_RECORD_IDLE && state != AUTOTUNE_RECORD_PRESSED) {
+    return;
+  }
+  if (time_us_64() - record_start_us < autotune_record_duration_us) {
+    return;
+  }
+
+  if (state == AUTOTUNE_RECORD_IDLE) {
+    autotune_sensor_idx = 0;
+    state = AUTOTUNE_WAIT_PRESSED;
+    print_pressed_prompt();
+  } else if (autotune_sensor_idx + 1 < num_touch_sensors) {
+    autotune_sensor_idx++;
+    state = AUTOTUNE_WAIT_PRESSED;
+    CDC_PUTS(autotune_itf, "done, step off");
+    print_pressed_prompt();
+  } else {
+    CDC_PUTS(autotune_itf, "done, step off");
+    finish_autotune();
+    state = AUTOTUNE_INACTIVE;
+    tud_cdc_n_write_str(autotune_itf, "> ");
+    CDC_FLUSH(autotune_itf);
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <math.h>
+#include <string_view>
+
+#include "touch_sensor_thread.hpp"
+
+// running mean and variance (Welford's algorithm)
+struct mean_variance_accumulator {
+  uint32_t count = 0;
+  float mean = 0;
+  float m2 = 0;
+
+  inline void add_value(float v) {
+    count++;
+    float delta = v - mean;
+    mean += delta / count;
+    m2 += delta * (v - mean);
+  }
+
+  inline float get_variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+  inline float get_stddev() const { return sqrtf(get_variance()); }
+
+  inline void reset() { *this = mean_variance_accumulator(); }
+};
+
+// interactive threshold calibration, driven from the serial console
+void autotune_start(uint8_t itf);
+bool autotune_is_active();
+// lines typed into the console are forwarded here while autotune is active
+void autotune_handle_line(uint8_t itf, std::string_view line);
+// called for every touchpad_stats_t frame received from core1
+void autotune_add_frame(const touchpad_stats_t& frame);
+void autotune_task();
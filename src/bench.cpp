@@ -0,0 +1,181 @@
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include "autotune.hpp"
+#include "bench.hpp"
+#include "config_defines.h"
+#include "custom_logging.hpp"
+#include "kernel_bench.hpp"
+
+constexpr uint64_t bench_phase_duration_us = 2 * 1000 * 1000;
+
+enum bench_phase_t {
+  BENCH_PHASE_IDLE_USB = 0,
+  BENCH_PHASE_CDC_FLOOD = 1,
+  NUM_BENCH_PHASES,
+};
+static const char* bench_phase_names[NUM_BENCH_PHASES] = {"usb idle", "cdc flood"};
+
+struct bench_phase_stats_t {
+  // full rounds over all sensors per second, for each window
+  mean_variance_accumulator rate;
+  float min_rate = INFINITY;
+  float max_rate = 0;
+  // time between the end of one window and the start of the next
+  mean_variance_accumulator gap_us;
+  uint32_t max_gap_us = 0;
+};
+
+// written by core1 while bench_phase is set, read by core0 once core1 has acknowledged that it's cleared
+static bench_phase_stats_t bench_results[NUM_BENCH_PHASES];
+static volatile int bench_phase = -1;
+// the bench_phase core1 saw at its last window
+static volatile int bench_phase_seen = -1;
+static uint64_t last_window_end_us = 0;
+
+void __time_critical_func(bench_add_window)(const std::array<running_stats, num_touch_sensors>& by_sensor,
+                                            uint64_t start_us, uint64_t end_us) {
+  int phase = bench_phase;
+  // results of earlier windows are visible before the acknowledgement
+  __dmb();
+  bench_phase_seen = phase;
+  uint64_t prev_end_us = last_window_end_us;
+  last_window_end_us = end_us;
+  if (phase < 0 || prev_end_us == 0 || end_us <= start_us) {
+    return;
+  }
+  bench_phase_stats_t& r = bench_results[phase];
+
+  count_t rounds = UINT32_MAX;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    rounds = MIN(rounds, by_sensor[i].get_total_count());
+  }
+  float rate = rounds * 1.0e6f / (float)(end_us - start_us);
+  r.rate.add_value(rate);
+  r.min_rate = MIN(r.min_rate, rate);
+  r.max_rate = MAX(r.max_rate, rate);
+
+  uint32_t gap_us = start_us > prev_end_us ? start_us - prev_end_us : 0;
+  r.gap_us.add_value(gap_us);
+  r.max_gap_us = MAX(r.max_gap_us, gap_us);
+}
+
+// core0 side
+
+enum bench_state_t {
+  BENCH_INACTIVE,
+  BENCH_RUNNING,
+  // wait for core1 to acknowledge the end of the last phase
+  BENCH_FINISHING,
+  BENCH_OPS,
+};
+static bench_state_t state = BENCH_INACTIVE;
+static uint8_t bench_itf = 0;
+static uint64_t phase_start_us = 0;
+static uint32_t flood_lines = 0;
+static size_t ops_case = 0;
+constexpr uint64_t bench_ops_min_duration_ns = 10 * 1000 * 1000;
+
+static void set_phase(int phase) {
+  __dmb();
+  bench_phase = phase;
+  phase_start_us = time_us_64();
+}
+
+void bench_start(uint8_t itf) {
+  bench_itf = itf;
+  for (uint i = 0; i < NUM_BENCH_PHASES; i++) {
+    bench_results[i] = bench_phase_stats_t();
+  }
+  flood_lines = 0;
+  CDC_PRINTF(itf, "measuring sample rate jitter for %llu s with USB idle, then %llu s flooding this console\r\n",
+             bench_phase_duration_us / 1000000, bench_phase_duration_us / 1000000);
+  CDC_FLUSH(itf);
+  state = BENCH_RUNNING;
+  bench_phase_seen = BENCH_PHASE_IDLE_USB;
+  set_phase(BENCH_PHASE_IDLE_USB);
+}
+
+void bench_ops_start(uint8_t itf) {
+  bench_itf = itf;
+  ops_case = 0;
+  CDC_PRINTF(itf, "# sys clock: %lu kHz, %u cases\r\n", clock_get_hz(clk_sys) / 1000, (uint)kernel_bench_num_cases());
+  CDC_PUTS(itf, KERNEL_BENCH_CSV_HEADER);
+  CDC_FLUSH(itf);
+  state = BENCH_OPS;
+}
+
+static uint64_t time_ns() {
+  return time_us_64() * 1000;
+}
+
+static void bench_ops_task() {
+  // wait for room for the line, so no results get dropped
+  if (tud_cdc_n_write_available(bench_itf) < FORMAT_BUFFER_SIZE / 2) {
+    tud_cdc_n_write_flush(bench_itf);
+    return;
+  }
+  kernel_bench_result r = kernel_bench_run(ops_case, time_ns, bench_ops_min_duration_ns);
+  CDC_PRINTF(bench_itf, "%s,%lu,%lu,%lu,%.1f,%.3f\r\n", r.kernel, r.sensors, r.window, r.reps, r.ns_per_window(),
+             r.ns_per_sample());
+  tud_cdc_n_write_flush(bench_itf);
+  if (++ops_case >= kernel_bench_num_cases()) {
+    state = BENCH_INACTIVE;
+  }
+}
+
+bool bench_is_active() {
+  return state != BENCH_INACTIVE;
+}
+
+static void print_bench_results(uint8_t itf) {
+  CDC_PRINTF(itf, "sys clock: %lu kHz, core1 scratch placement: %s, cdc flood: %lu lines\r\n",
+             clock_get_hz(clk_sys) / 1000, CORE1_SCRATCH ? "on" : "off", flood_lines);
+  CDC_PUTS(itf, "phase     | windows | rounds/s mean  stddev     min     max | gap us mean  stddev  max");
+  for (uint i = 0; i < NUM_BENCH_PHASES; i++) {
+    const bench_phase_stats_t& r = bench_results[i];
+    CDC_PRINTF(itf, "%-9s | %7lu | %13.0f %7.1f %7.0f %7.0f | %11.1f %7.1f %4lu\r\n", bench_phase_names[i],
+               r.rate.count, r.rate.mean, r.rate.get_stddev(), r.rate.count ? r.min_rate : 0, r.max_rate,
+               r.gap_us.mean, r.gap_us.get_stddev(), r.max_gap_us);
+    CDC_FLUSH(itf);
+  }
+}
+
+void bench_task() {
+  if (state == BENCH_INACTIVE) {
+    return;
+  }
+  if (state == BENCH_OPS) {
+    bench_ops_task();
+    return;
+  }
+  uint64_t now = time_us_64();
+  if (state == BENCH_FINISHING) {
+    if (bench_phase_seen < 0) {
+      __dmb();
+      print_bench_results(bench_itf);
+      state = BENCH_INACTIVE;
+    }
+    return;
+  }
+
+  if (bench_phase == BENCH_PHASE_CDC_FLOOD) {
+    // roughly what teleplot output looks like, as fast as USB takes it
+    while (tud_cdc_n_write_available(bench_itf) >= FORMAT_BUFFER_SIZE / 2) {
+      CDC_PRINTF(bench_itf, ">flood:%llu:%f\r\n", now, (double)flood_lines * 0.1);
+      flood_lines++;
+    }
+    tud_cdc_n_write_flush(bench_itf);
+  }
+
+  if (now - phase_start_us >= bench_phase_duration_us) {
+    if (bench_phase + 1 < NUM_BENCH_PHASES) {
+      set_phase(bench_phase + 1);
+    } else {
+      set_phase(-1);
+      state = BENCH_FINISHING;
+    }
+  }
+}
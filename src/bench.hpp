@@ -0,0 +1,23 @@
+#pragma once
+#include <array>
+
+#include "running_stats.hpp"
+#include "touch_sensor_config.hpp"
+
+/**
+ * sample rate jitter benchmark (`bench` console command). core1 records the sample rate of every window and the gap
+ * between windows, first with USB idle and then while core0 floods the console with formatted output, to see how much
+ * core0's USB work slows down sampling (see CORE1_SCRATCH).
+ *
+ * `bench ops` instead times the running_stats methods and filter checks on core0 (see kernel_bench.hpp), one case
+ * per bench_task call so USB keeps running, and prints CSV.
+ */
+
+// called by core1 for every sampling (sub-)window, start_us is when sampling began
+void bench_add_window(const std::array<running_stats, num_touch_sensors>& by_sensor, uint64_t start_us,
+                      uint64_t end_us);
+
+void bench_start(uint8_t itf);
+void bench_ops_start(uint8_t itf);
+bool bench_is_active();
+void bench_task();
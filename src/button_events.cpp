@@ -0,0 +1,64 @@
+#include "tusb.h"
+
+#include "button_events.hpp"
+#include "custom_logging.hpp"
+#include "touch_sensor_config.hpp"
+
+#define BUTTON_EVENTS_CSV_HEADER "seq,timestamp_us,button,event,sensor,filtered_value,margin"
+
+static bool following = false;
+static uint8_t follow_itf = 0;
+static uint32_t next_seq = 0;
+
+static void print_button_event(uint8_t itf, uint32_t seq, const button_event_t& e) {
+  CDC_PRINTF(itf, "%lu,%llu,%s,%s,%u,%.1f,%.1f\r\n", seq, e.timestamp_us, game_button_short_labels[e.button],
+             e.pressed ? "press" : "release", e.sensor, e.filtered_value, e.margin);
+}
+
+void print_button_events(uint8_t itf) {
+  uint32_t head = button_events.get_head();
+  CDC_PUTS(itf, BUTTON_EVENTS_CSV_HEADER);
+  uint32_t seq = head >= BUTTON_EVENT_LOG_SIZE ? head - (BUTTON_EVENT_LOG_SIZE - 1) : 0;
+  for (; seq < head; seq++) {
+    button_event_t e;
+    // the oldest ones can get overwritten while we're printing
+    if (button_events.get(seq, e)) {
+      print_button_event(itf, seq, e);
+    }
+  }
+  CDC_FLUSH(itf);
+}
+
+void follow_button_events(uint8_t itf, bool enabled) {
+  following = enabled;
+  follow_itf = itf;
+  next_seq = button_events.get_head();
+  if (enabled) {
+    CDC_PUTS(itf, BUTTON_EVENTS_CSV_HEADER);
+    CDC_FLUSH(itf);
+  }
+}
+
+void button_events_task() {
+  if (!following) {
+    return;
+  }
+  uint32_t head = button_events.get_head();
+  if (head == next_seq) {
+    return;
+  }
+  while (next_seq != head) {
+    button_event_t e;
+    if (button_events.get(next_seq, e)) {
+      print_button_event(follow_itf, next_seq, e);
+      next_seq++;
+    } else {
+      // core1 got a whole log ahead of us, skip to the oldest event that's still there
+      head = button_events.get_head();
+      uint32_t oldest = head - (BUTTON_EVENT_LOG_SIZE - 1);
+      CDC_PRINTF(follow_itf, "# missed events %lu to %lu\r\n", next_seq, oldest - 1);
+      next_seq = oldest;
+    }
+  }
+  CDC_FLUSH(follow_itf);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+
+// must be a power of 2
+#define BUTTON_EVENT_LOG_SIZE 256
+
+// a press or release of a game button, after fusion and debounce
+struct button_event_t {
+  // time of the last sample of the window it was decided on
+  uint64_t timestamp_us;
+  // filtered value of the button's sensor that is furthest above its threshold (see sensor_values)
+  float filtered_value;
+  // filtered_value - threshold, negative for most releases
+  float margin;
+  uint8_t button;
+  uint8_t sensor;
+  bool pressed;
+};
+
+// the most recent BUTTON_EVENT_LOG_SIZE button events. written by core1 (single producer) and read by core0 without
+// locking: a reader checks afterwards that the slot wasn't overwritten while it was copying
+class button_event_log {
+  button_event_t events[BUTTON_EVENT_LOG_SIZE];
+  // number of events ever written, events[head % size] is the next one
+  volatile uint32_t head = 0;
+
+ public:
+  inline void push(const button_event_t& e) {
+    uint32_t h = head;
+    events[h % BUTTON_EVENT_LOG_SIZE] = e;
+    __dmb();
+    head = h + 1;
+  }
+
+  inline uint32_t get_head() const { return head; }
+
+  // whether event seq is readable: already written, and its slot isn't the one the next push() goes to
+  inline bool is_available(uint32_t seq) const { return head - seq - 1 < BUTTON_EVENT_LOG_SIZE - 1; }
+
+  // copy event number seq (counting from boot), false if it doesn't exist yet or was overwritten while copying
+  inline bool get(uint32_t seq, button_event_t& e) const {
+    if (!is_available(seq)) {
+      return false;
+    }
+    __dmb();
+    e = events[seq % BUTTON_EVENT_LOG_SIZE];
+    __dmb();
+    return is_available(seq);
+  }
+};
+
+extern button_event_log button_events;
+
+// `events` console command: print the logged events as CSV, or keep printing new ones to this console
+void print_button_events(uint8_t itf);
+void follow_button_events(uint8_t itf, bool enabled);
+void button_events_task();
@@ -30,6 +30,20 @@ constexpr bool log_extra_sensor_info = false;
 #define SERIAL_CONFIG_CONSOLE_INTERFACE CDC_SERIAL0_ITF
 #endif // SERIAL_CONFIG_CONSOLE
 
+// put core1's sampling loop and its accumulators in the SRAM4 scratch bank, next to core1's stack, so that core0's
+// USB and console work in the striped main SRAM doesn't stall it. see the CORE1_SCRATCH cmake option
+#ifndef CORE1_SCRATCH
+#define CORE1_SCRATCH 0
+#endif  // CORE1_SCRATCH
+
+#if CORE1_SCRATCH
+#define __core1_func(func_name) __scratch_x(#func_name) func_name
+#define __core1_data(group) __scratch_x(group)
+#else
+#define __core1_func(func_name) __time_critical_func(func_name)
+#define __core1_data(group)
+#endif  // CORE1_SCRATCH
+
 #ifndef TOUCH_SINGLE_SAMPLE_DEBUG
 #define TOUCH_SINGLE_SAMPLE_DEBUG 0
 // #define TOUCH_SINGLE_SAMPLE_DEBUG 1
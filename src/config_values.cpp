@@ -0,0 +1,56 @@
+#include "config_values.hpp"
+
+// defaults for everything in the config values table (see serial_config_console.cpp). kept apart from the console so
+// the decision code can be built on its own, see host/
+
+#ifndef DEFAULT_THRESHOLD_FACTOR
+#define DEFAULT_THRESHOLD_FACTOR 1.5
+#endif  // DEFAULT_THRESHOLD_FACTOR
+#ifndef DEFAULT_THRESHOLD_VALUE
+#define DEFAULT_THRESHOLD_VALUE 150.0
+#endif  // DEFAULT_THRESHOLD_VALUE
+
+#ifndef DEFAULT_TOUCH_ACCUM_SHIFT
+#define DEFAULT_TOUCH_ACCUM_SHIFT 0
+#endif  // DEFAULT_TOUCH_ACCUM_SHIFT
+
+per_sensor_config<float> threshold_factor = per_sensor_default<float>(DEFAULT_THRESHOLD_FACTOR);
+per_sensor_config<float> threshold_value = per_sensor_default<float>(DEFAULT_THRESHOLD_VALUE);
+int threshold_type = THRESHOLD_TYPE_VALUE;
+uint64_t threshold_sampling_duration_us = 2 * 1000 * 1000;
+uint64_t sampling_duration_us = 1 * 1000;
+uint64_t sys_clock_khz = 125000;
+uint64_t touch_accum_shift = DEFAULT_TOUCH_ACCUM_SHIFT;
+uint64_t sliding_window_subwindows = 4;
+bool adaptive_window_enabled = false;
+uint64_t adaptive_window_min_us = 500;
+uint64_t adaptive_window_max_us = 4 * 1000;
+float adaptive_window_margin = 0.25;
+bool sof_sync_enabled = true;
+uint64_t sof_sync_lead_us = 150;
+uint64_t serial_teleplot_report_interval_us = 80 * 1000;
+bool teleplot_normalize_values = true;
+int filter_type = FILTER_TYPE_MEDIAN;
+bool usb_hid_enabled = true;
+bool low_power_scan_enabled = true;
+uint64_t low_power_scan_interval_us = 20 * 1000;
+uint64_t remote_wakeup_hold_us = 30 * 1000;
+float iir_filter_b = 0.8;
+float sprt_press_confidence = 9.0;
+float sprt_release_confidence = 6.0;
+per_sensor_config<float> sprt_press_delta = per_sensor_default<float>(0.0);
+uint64_t sprt_min_samples = 8;
+float kalman_signal_q = 0.02;
+uint64_t kalman_signal_decay_shift = 14;
+uint64_t sleep_us_between_samples = 0;
+per_sensor_config<uint64_t> debounce_us = per_sensor_default<uint64_t>(10000);  // 10ms
+per_sensor_config<float> hysteresis = per_sensor_default<float>(50.0);
+bool health_monitor_enabled = true;
+uint64_t health_fault_windows = 1000;
+float health_baseline_jump = 100.0;
+int fusion_type = FUSION_TYPE_ANY;
+per_sensor_config<float> fusion_weight = per_sensor_default<float>(1.0);
+bool common_mode_rejection = false;
+std::array<int, num_touch_sensors * num_touch_sensors> crosstalk = {0};
+float autotune_idle_sigmas = 6.0;
+uint64_t autotune_record_duration_us = 2 * 1000 * 1000;
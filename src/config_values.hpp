@@ -1,32 +1,127 @@
 #pragma once
+#include <array>
+
+#include "touch_sensor_config.hpp"
+
+// per-sensor config values are indexed the same way as touch_sensor_configs
+template <typename T>
+using per_sensor_config = std::array<T, num_touch_sensors>;
+
+// fill every sensor with the same default value
+template <typename T>
+constexpr per_sensor_config<T> per_sensor_default(T value) {
+  per_sensor_config<T> values{};
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = value;
+  }
+  return values;
+}
 
 // config values:
-extern float threshold_factor;
-extern float threshold_value;
+extern per_sensor_config<float> threshold_factor;
+extern per_sensor_config<float> threshold_value;
 extern int threshold_type;
 extern uint64_t threshold_sampling_duration_us;
 extern uint64_t sampling_duration_us;
+// applied at boot (save and replug after changing it), clamped to [MIN_SYS_CLOCK_KHZ, MAX_SYS_CLOCK_KHZ]
+extern uint64_t sys_clock_khz;
+#define MIN_SYS_CLOCK_KHZ 125000
+#define MAX_SYS_CLOCK_KHZ 250000
+// every sample is the mean of 2^touch_accum_shift measurements, added up by the state machine, so core1 reads the
+// FIFO that much less often. applied at the next calibration, clamped to TOUCH_ACCUM_MAX_SHIFT. sequential and IRQ
+// polling only. a sequential round takes 2^touch_accum_shift times longer, keep it well under a sub-window
+extern uint64_t touch_accum_shift;
+// each sampling window is made of this many sub-windows, and stats are published after every sub-window (always
+// covering the whole window), so a press is seen after one sub-window instead of up to two whole windows
+extern uint64_t sliding_window_subwindows;
+// shorten the window when a sensor is near its threshold, lengthen it while nothing is happening
+extern bool adaptive_window_enabled;
+extern uint64_t adaptive_window_min_us;
+extern uint64_t adaptive_window_max_us;
+// "near" is within this fraction of (threshold - baseline) from the threshold
+extern float adaptive_window_margin;
+// align the end of each sampling window to the USB start of frame, so the result is ready right before the host polls
+extern bool sof_sync_enabled;
+// how long before the SOF each sampling window should end, to leave time to build the HID report
+extern uint64_t sof_sync_lead_us;
 extern uint64_t serial_teleplot_report_interval_us;
 extern bool teleplot_normalize_values;
 extern bool usb_hid_enabled;
+// scan only once per low_power_scan_interval_us while USB is suspended or unmounted
+extern bool low_power_scan_enabled;
+extern uint64_t low_power_scan_interval_us;
+// while suspended, wake the host once a button has been held this long
+extern uint64_t remote_wakeup_hold_us;
 extern int filter_type;
 extern float iir_filter_b;
+// FILTER_TYPE_SPRT: evidence needed to press/release, as log10 odds. a false press happens about once every
+// 10^sprt_press_confidence samples of an idle sensor
+extern float sprt_press_confidence;
+extern float sprt_release_confidence;
+// FILTER_TYPE_SPRT: pressed mean minus idle mean of each sensor (`autotune` measures it), 0 assumes the threshold is
+// halfway between them
+extern per_sensor_config<float> sprt_press_delta;
+// FILTER_TYPE_SPRT: a single sample adds at most 1/sprt_min_samples of the evidence needed, so a spike can't press
+extern uint64_t sprt_min_samples;
+// FILTER_TYPE_KALMAN: how fast the touch signal can move, as its per-sample variance relative to the sample noise.
+// higher follows presses with less lag, but lets more noise through
+extern float kalman_signal_q;
+// FILTER_TYPE_KALMAN: the touch signal decays by 1/2^kalman_signal_decay_shift per sample while not pressed, whatever
+// stays is moved into the tracked baseline
+extern uint64_t kalman_signal_decay_shift;
 // `sleep_us_between_samples` was added in an attempt to reduce signal noise. It did not work, and should be set to 0.
 extern uint64_t sleep_us_between_samples;
 // NOTE: this is us (microseconds), NOT ms (milliseconds)
-extern uint64_t debounce_us;
+extern per_sensor_config<uint64_t> debounce_us;
 // set to 0 to disable hysteresis
-extern float hysteresis;
+extern per_sensor_config<float> hysteresis;
+// exclude sensors that look broken (see sensor_health.hpp) from the button decisions
+extern bool health_monitor_enabled;
+// number of consecutive (sub-)windows a sensor must look broken (or healthy again) before its state changes
+extern uint64_t health_fault_windows;
+// a window mean this far below the baseline marks the sensor as broken, 0 disables this check
+extern float health_baseline_jump;
+// how sensors mapped to the same game button are combined, see FUSION_TYPE_*
+extern int fusion_type;
+// per-sensor weight for FUSION_TYPE_VOTE (`autotune` sets it to the sensor's signal to noise ratio)
+extern per_sensor_config<float> fusion_weight;
+// subtract the median shift of the idle sensors from all sensors before thresholding. FILTER_TYPE_MEDIAN and
+// FILTER_TYPE_SPRT only see raw samples, they get the estimate of the previous window added to their threshold
+extern bool common_mode_rejection;
+// crosstalk[i * num_touch_sensors + j] is the share of sensor j's signal (above its baseline) that shows up on sensor i,
+// in fixed point with CROSSTALK_FRACTION_BITS fraction bits. it is measured by `autotune`, all 0 disables compensation
+extern std::array<int, num_touch_sensors * num_touch_sensors> crosstalk;
+// thresholds picked by `autotune` are at least this many idle standard deviations above the idle mean
+extern float autotune_idle_sigmas;
+// how long `autotune` records each idle/pressed distribution
+extern uint64_t autotune_record_duration_us;
 // TODO: player1/player2 config option
 
 // TODO: add weighted moving average and hull moving average
 #define FILTER_TYPE_MEDIAN 0
 #define FILTER_TYPE_AVG 1
 #define FILTER_TYPE_IIR 2
+// decides on every sample instead of once per window, see sprt.hpp
+#define FILTER_TYPE_SPRT 3
+// tracks the baseline drift under the touch signal, see kalman.hpp
+#define FILTER_TYPE_KALMAN 4
+
+// each sensor is thresholded on its own and any active sensor activates the button
+#define FUSION_TYPE_ANY 0
+// signals are normalized (0 at baseline, 1 at threshold) and the button is active when their average reaches 1
+#define FUSION_TYPE_SUM 1
+// the button is active when the strongest normalized signal reaches 1
+#define FUSION_TYPE_MAX 2
+// like FUSION_TYPE_SUM, but each sensor's normalized signal is weighted by fusion_weight
+#define FUSION_TYPE_VOTE 3
+
+#define CROSSTALK_FRACTION_BITS 12
 
 #define THRESHOLD_TYPE_FACTOR 0
 #define THRESHOLD_TYPE_VALUE 1
 
+#define MAX_SLIDING_WINDOW_SUBWINDOWS 8
+
 // TODO: make these config values
 // value subtracted from sampling_duration_us to account for processing time
 #define sampling_buffer_time_us (100)
@@ -0,0 +1,51 @@
+#pragma once
+#include "pico/stdlib.h"
+
+/**
+ * 2-state kalman filter on the raw samples of one sensor (FILTER_TYPE_KALMAN): the touch signal and the baseline
+ * under it, observed together as their sum.
+ *
+ * the signal is a fast random walk that slowly decays back to 0 (kalman_signal_q, kalman_signal_decay_shift), the
+ * baseline a very slow random walk (the drift measured with the baseline). noise variances come from the baseline
+ * calibration. the gains are the steady-state ones, computed per state as if the other one was noise (the baseline
+ * moves orders of magnitude slower than the signal), so a sample only costs two multiplies. while the sensor is
+ * pressed the baseline is held, so a long press isn't absorbed into it.
+ */
+
+#define KALMAN_STATE_FRACTION_BITS 16
+#define KALMAN_GAIN_FRACTION_BITS 24
+
+struct kalman_params_t {
+  // steady-state gains, fixed point with KALMAN_GAIN_FRACTION_BITS
+  int32_t signal_gain;
+  int32_t baseline_gain;
+  // the signal decays by 1/2^decay_shift per sample while the sensor isn't pressed
+  uint8_t decay_shift;
+};
+
+struct kalman_tracker {
+  // raw counts, fixed point with KALMAN_STATE_FRACTION_BITS
+  int32_t signal = 0;
+  int32_t baseline = INT32_MIN;
+
+  inline void add_value(int32_t v, const kalman_params_t& p, bool pressed) {
+    int32_t z = v << KALMAN_STATE_FRACTION_BITS;
+    if (baseline == INT32_MIN) {
+      baseline = z;
+      return;
+    }
+    if (!pressed) {
+      signal -= signal >> p.decay_shift;
+    }
+    int32_t innovation = z - baseline - signal;
+    signal += (int32_t)(((int64_t)innovation * p.signal_gain) >> KALMAN_GAIN_FRACTION_BITS);
+    if (!pressed) {
+      baseline += (int32_t)(((int64_t)innovation * p.baseline_gain) >> KALMAN_GAIN_FRACTION_BITS);
+    }
+  }
+
+  // counts above the tracked baseline
+  inline float get_signal() const { return signal * (1.0f / (1 << KALMAN_STATE_FRACTION_BITS)); }
+  inline float get_baseline() const { return baseline * (1.0f / (1 << KALMAN_STATE_FRACTION_BITS)); }
+  inline bool has_baseline() const { return baseline != INT32_MIN; }
+};
@@ -0,0 +1,165 @@
+#include "pico/stdlib.h"
+
+#include "kernel_bench.hpp"
+#include "running_stats.hpp"
+
+constexpr uint kernel_bench_window_sizes[] = {16, 64, 256};
+constexpr uint kernel_bench_sensor_counts[] = {1, 4, 8};
+constexpr uint kernel_bench_max_sensors = 8;
+
+// raw counts around a typical idle value, interleaved by sensor like the sampling loop produces them
+constexpr uint kernel_bench_num_samples = 1024;
+static value_t kernel_bench_samples[kernel_bench_num_samples];
+static running_stats kernel_bench_stats[kernel_bench_max_sensors];
+// idle around 1000 with a stddev of about 10, pressed 100 counts higher
+static const sprt_params_t kernel_bench_sprt_params = {1050, 256, 5304, 3536, 442};
+// the defaults for that noise and no measurable drift
+static const kalman_params_t kernel_bench_kalman_params = {2210808, 41, 14};
+
+// keep the compiler from dropping results nobody reads
+static volatile float float_sink;
+static volatile bool bool_sink;
+
+static inline value_t sample(uint k, uint sensors, uint i) {
+  return kernel_bench_samples[(k * sensors + i) % kernel_bench_num_samples];
+}
+
+// one window of work over stats[0..sensors)
+typedef void (*kernel_fn)(running_stats* stats, uint sensors, uint window);
+
+static void __time_critical_func(kernel_add_value)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    stats[i].reset();
+    stats[i].threshold = 1000;
+  }
+  for (uint k = 0; k < window; k++) {
+    for (uint i = 0; i < sensors; i++) {
+      stats[i].add_value(sample(k, sensors, i));
+    }
+  }
+}
+
+static void __time_critical_func(kernel_merge)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    running_stats merged;
+    merged.merge(stats[i]);
+    float_sink = (float)merged.sum;
+  }
+}
+
+static void __time_critical_func(kernel_mean)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    float_sink = stats[i].get_mean_float();
+  }
+}
+
+static void __time_critical_func(kernel_filtered_value)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    float_sink = stats[i].get_filtered_value(filter_type);
+  }
+}
+
+static void __time_critical_func(kernel_median)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    bool_sink = stats[i].median_is_above_threshold_hysteresis(false, 10);
+  }
+}
+
+static void __time_critical_func(kernel_avg)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    bool_sink = stats[i].avg_is_above_threshold_hysteresis(false, 10);
+  }
+}
+
+static void __time_critical_func(kernel_iir)(running_stats* stats, uint sensors, uint window) {
+  for (uint i = 0; i < sensors; i++) {
+    bool_sink = stats[i].iir_is_above_threshold_hysteresis(false, 10);
+  }
+}
+
+static void __time_critical_func(kernel_sprt)(running_stats* stats, uint sensors, uint window) {
+  bool changed = false;
+  for (uint k = 0; k < window; k++) {
+    for (uint i = 0; i < sensors; i++) {
+      changed |= stats[i].sprt.add_value(sample(k, sensors, i), kernel_bench_sprt_params);
+    }
+  }
+  bool_sink = changed;
+}
+
+static void __time_critical_func(kernel_kalman)(running_stats* stats, uint sensors, uint window) {
+  for (uint k = 0; k < window; k++) {
+    for (uint i = 0; i < sensors; i++) {
+      stats[i].kalman.add_value(sample(k, sensors, i), kernel_bench_kalman_params, false);
+    }
+  }
+  float_sink = stats[0].kalman.get_signal();
+}
+
+struct kernel_bench_kernel {
+  const char* name;
+  kernel_fn fn;
+};
+// everything but add_value runs on stats already filled by add_value
+static const kernel_bench_kernel kernel_bench_kernels[] = {
+    {"add_value", kernel_add_value},
+    {"merge", kernel_merge},
+    {"get_mean_float", kernel_mean},
+    {"get_filtered_value", kernel_filtered_value},
+    {"filter_median", kernel_median},
+    {"filter_avg", kernel_avg},
+    {"filter_iir", kernel_iir},
+    // per sample, on top of add_value
+    {"filter_sprt", kernel_sprt},
+    {"filter_kalman", kernel_kalman},
+};
+
+constexpr size_t kernel_bench_cases_per_kernel = count_of(kernel_bench_window_sizes) * count_of(kernel_bench_sensor_counts);
+
+size_t kernel_bench_num_cases() {
+  return count_of(kernel_bench_kernels) * kernel_bench_cases_per_kernel;
+}
+
+static void fill_samples() {
+  static bool filled = false;
+  if (filled) {
+    return;
+  }
+  // the sum of 12 uniforms in [0, 1000) is close to a gaussian with mean 5994 and stddev 1000, scaled to the idle
+  // noise the params above are for
+  uint32_t x = 2463534242u;
+  for (uint k = 0; k < kernel_bench_num_samples; k++) {
+    int32_t sum = 0;
+    for (uint j = 0; j < 12; j++) {
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      sum += x % 1000;
+    }
+    kernel_bench_samples[k] = 1000 + (sum - 5994) / 100;
+  }
+  filled = true;
+}
+
+kernel_bench_result kernel_bench_run(size_t idx, uint64_t (*now_ns)(), uint64_t min_duration_ns) {
+  fill_samples();
+  const kernel_bench_kernel& kernel = kernel_bench_kernels[idx / kernel_bench_cases_per_kernel];
+  size_t c = idx % kernel_bench_cases_per_kernel;
+  uint window = kernel_bench_window_sizes[c / count_of(kernel_bench_sensor_counts)];
+  uint sensors = kernel_bench_sensor_counts[c % count_of(kernel_bench_sensor_counts)];
+
+  kernel_add_value(kernel_bench_stats, sensors, window);
+  kernel_bench_result result = {kernel.name, sensors, window, 0, 0};
+  for (uint32_t reps = 1;; reps *= 2) {
+    uint64_t start = now_ns();
+    for (uint32_t r = 0; r < reps; r++) {
+      kernel.fn(kernel_bench_stats, sensors, window);
+    }
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed >= min_duration_ns || reps >= (1u << 30)) {
+      result.reps = reps;
+      result.elapsed_ns = elapsed;
+      return result;
+    }
+  }
+}
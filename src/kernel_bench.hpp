@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * per-sample cost of the running_stats methods and filter checks that run in the core1 sampling loop, for every
+ * window size and sensor count in kernel_bench_window_sizes/kernel_bench_sensor_counts. shared by the host benchmark
+ * (host/kernel_bench.cpp) and `bench ops` on the device, which only differ in the clock they pass in.
+ *
+ * results are printed as CSV (KERNEL_BENCH_CSV_HEADER), one line per case:
+ *   ns_per_window - one window's worth of work over all sensors
+ *   ns_per_sample - the same, divided by sensors * window samples (what counts against the sampling budget)
+ */
+
+#define KERNEL_BENCH_CSV_HEADER "kernel,sensors,window,reps,ns_per_window,ns_per_sample"
+
+struct kernel_bench_result {
+  const char* kernel;
+  uint32_t sensors;
+  uint32_t window;
+  uint32_t reps;
+  uint64_t elapsed_ns;
+
+  inline double ns_per_window() const { return (double)elapsed_ns / reps; }
+  inline double ns_per_sample() const { return ns_per_window() / ((double)sensors * window); }
+};
+
+size_t kernel_bench_num_cases();
+
+// times case idx, doubling the repetitions until it takes at least min_duration_ns. now_ns is a monotonic clock
+kernel_bench_result kernel_bench_run(size_t idx, uint64_t (*now_ns)(), uint64_t min_duration_ns);
@@ -4,10 +4,11 @@
 #include <stdio.h>
 #include <array>
 #include <numeric>
-#include <vector>
 
+#include "hardware/clocks.h"
 #include "hardware/pio.h"
 #include "hardware/timer.h"
+#include "hardware/vreg.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 
@@ -18,11 +19,16 @@
 #include "tusb.h"
 #include "usb_descriptors.h"
 
+#include "autotune.hpp"
+#include "bench.hpp"
+#include "button_events.hpp"
 #include "config_defines.h"
 #include "custom_logging.hpp"
 #include "serial_config_console.hpp"
+#include "sof_sync.hpp"
 #include "teleplot_task.hpp"
 #include "touch_hid_tasks.hpp"
+#include "vendor_protocol.hpp"
 
 #include "touch.pio.h"
 
@@ -41,12 +47,33 @@ static bool web_serial_connected = false;
 void led_blinking_task(void);
 void webserial_task(void);
 
+// the PIO programs divide the system clock back down to TOUCH_PIO_CLOCK_KHZ, so sensor counts are the same at every
+// clock and only the CPU side gets faster
+static void apply_sys_clock_config() {
+  uint32_t khz = MIN(MAX(sys_clock_khz, MIN_SYS_CLOCK_KHZ), MAX_SYS_CLOCK_KHZ);
+  uint vco_freq, post_div1, post_div2;
+  if (!check_sys_clock_khz(khz, &vco_freq, &post_div1, &post_div2)) {
+    return;
+  }
+  if (khz > 200000) {
+    // overclocking past 200MHz needs a bit more core voltage, give it time to settle before speeding up
+    vreg_set_voltage(VREG_VOLTAGE_1_15);
+    busy_wait_us(10 * 1000);
+  }
+  set_sys_clock_khz(khz, true);
+}
+
 int main() {
+  // the clock is part of the saved config, so read that first, before anything depends on the clock
+  serial_console_init();
+  apply_sys_clock_config();
+
   board_init();
   tud_init(BOARD_TUD_RHPORT);
+  // for aligning the sampling windows to the host's polling, see sof_sync.hpp
+  tud_sof_cb_enable(true);
   stdio_init_all();
   init_queues();
-  serial_console_init();
 
   // force SMPS to PWM mode, to reduce ripple
   gpio_set_dir(23, GPIO_OUT);
@@ -59,6 +86,9 @@ int main() {
     hid_task();
     webserial_task();
     serial_console_task();
+    autotune_task();
+    bench_task();
+    button_events_task();
     led_blinking_task();
     teleplot_task();
   }
@@ -68,14 +98,21 @@ int main() {
 // Device callbacks
 //--------------------------------------------------------------------+
 
+// tell core1 to slow down or speed up scanning. queue_try_add also wakes core1 if it's sleeping between scans
+static void set_scan_mode(scan_mode_t mode) {
+  queue_try_add(&q_scan_mode, &mode);
+}
+
 // Invoked when device is mounted
 void tud_mount_cb(void) {
   blink_interval_ms = BLINK_MOUNTED;
+  set_scan_mode(SCAN_MODE_FULL);
 }
 
 // Invoked when device is unmounted
 void tud_umount_cb(void) {
   blink_interval_ms = BLINK_NOT_MOUNTED;
+  set_scan_mode(SCAN_MODE_LOW_POWER);
 }
 
 // Invoked when usb bus is suspended
@@ -84,11 +121,19 @@ void tud_umount_cb(void) {
 void tud_suspend_cb(bool remote_wakeup_en) {
   (void)remote_wakeup_en;
   blink_interval_ms = BLINK_SUSPENDED;
+  set_scan_mode(SCAN_MODE_LOW_POWER);
 }
 
 // Invoked when usb bus is resumed
 void tud_resume_cb(void) {
   blink_interval_ms = BLINK_MOUNTED;
+  set_scan_mode(SCAN_MODE_FULL);
+}
+
+// Invoked on every start of frame (1ms), once enabled with tud_sof_cb_enable()
+void tud_sof_cb(uint32_t frame_count) {
+  (void)frame_count;
+  sof_sync_on_sof(time_us_64());
 }
 
 //--------------------------------------------------------------------+
@@ -138,9 +183,6 @@ bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_requ
         if (web_serial_connected) {
           board_led_write(true);
           blink_interval_ms = BLINK_ALWAYS_ON;
-
-          tud_vendor_write_str("\r\nWebUSB interface connected\r\n");
-          tud_vendor_flush();
         } else {
           blink_interval_ms = BLINK_MOUNTED;
         }
@@ -158,36 +200,9 @@ bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_requ
   return false;
 }
 
-// send characters to both CDC and WebUSB
-void echo_all(uint8_t buf[], uint32_t count) {
-  // echo to web serial
-  if (web_serial_connected) {
-    tud_vendor_write(buf, count);
-    tud_vendor_flush();
-  }
-
-  // echo to cdc
-  if (tud_cdc_connected()) {
-    for (uint32_t i = 0; i < count; i++) {
-      tud_cdc_write_char(buf[i]);
-
-      if (buf[i] == '\r')
-        tud_cdc_write_char('\n');
-    }
-    tud_cdc_write_flush();
-  }
-}
-
 void webserial_task(void) {
-  if (web_serial_connected) {
-    if (tud_vendor_available()) {
-      uint8_t buf[64];
-      uint32_t count = tud_vendor_read(buf, sizeof(buf));
-
-      // echo back to both web serial and cdc
-      echo_all(buf, count);
-    }
-  }
+  // the vendor interface speaks a binary protocol, see vendor_protocol.hpp
+  vendor_protocol_task();
 }
 
 //--------------------------------------------------------------------+
@@ -3,8 +3,12 @@
 
 queue_t q_blink_interval;
 queue_t q_touchpad_stats;
+queue_t q_touchpad_stats_extended;
+queue_t q_scan_mode;
 
 void init_queues() {
   queue_init(&q_blink_interval, sizeof(blink_interval_t), 10);
   queue_init(&q_touchpad_stats, sizeof(touchpad_stats_t), 1);
+  queue_init(&q_touchpad_stats_extended, sizeof(touchpad_stats_extended_t), 1);
+  queue_init(&q_scan_mode, sizeof(scan_mode_t), 4);
 }
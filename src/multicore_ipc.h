@@ -8,6 +8,8 @@ enum blink_interval_t {
   BLINK_SENSORS_INIT = 100,
   BLINK_SENSORS_CALIBRATING = 250,
   BLINK_SENSORS_OK = 0,
+  // at least one sensor is excluded by the health monitor
+  BLINK_SENSOR_FAULT = 200,
 
   BLINK_NOT_MOUNTED = 1500,
   BLINK_MOUNTED = 1000,
@@ -20,7 +22,15 @@ enum blink_interval_t {
 // queues for core1 to send data to core0
 extern queue_t q_blink_interval;
 extern queue_t q_touchpad_stats;
+extern queue_t q_touchpad_stats_extended;
+// how fast core1 scans the sensors
+enum scan_mode_t {
+  SCAN_MODE_FULL = 0,
+  // USB is suspended or unmounted, so nobody is listening to reports (see low_power_scan_interval_us)
+  SCAN_MODE_LOW_POWER = 1,
+};
+
 // queues for core0 to send data to core1
-// TODO: none so far
+extern queue_t q_scan_mode;
 
 void init_queues();
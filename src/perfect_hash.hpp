@@ -0,0 +1,67 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * compile-time perfect hashing for small tables of named entries (anything with a `std::string_view name` member),
+ * so lookups by name are one hash and one string compare, with no heap or runtime setup.
+ */
+
+constexpr uint32_t perfect_hash_name(std::string_view name, uint32_t seed) {
+  // FNV-1a, with the seed mixed into the offset basis
+  uint32_t h = 2166136261u ^ seed;
+  for (char c : name) {
+    h = (h ^ (uint8_t)c) * 16777619u;
+  }
+  // the low bits (used for the slot) of plain FNV-1a only depend on the low bits of the input, so mix in the high bits
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  return h;
+}
+
+template <size_t num_slots>
+struct perfect_hash_table {
+  static_assert((num_slots & (num_slots - 1)) == 0, "num_slots must be a power of two");
+  static constexpr uint8_t empty_slot = 0xff;
+
+  uint32_t seed = 0;
+  // index into the named table, or empty_slot
+  std::array<uint8_t, num_slots> slots = {};
+
+  constexpr bool valid() const { return seed != UINT32_MAX; }
+
+  template <typename T, size_t N>
+  constexpr int find(const T (&table)[N], std::string_view name) const {
+    uint8_t i = slots[perfect_hash_name(name, seed) & (num_slots - 1)];
+    if (i != empty_slot && table[i].name == name) {
+      return i;
+    }
+    return -1;
+  }
+};
+
+// tries seeds until every name lands in its own slot, seed is UINT32_MAX if none was found
+template <size_t num_slots, typename T, size_t N>
+constexpr perfect_hash_table<num_slots> make_perfect_hash_table(const T (&table)[N]) {
+  static_assert(N < perfect_hash_table<num_slots>::empty_slot, "too many entries");
+  perfect_hash_table<num_slots> result;
+  for (uint32_t seed = 0; seed < 1000; seed++) {
+    result.seed = seed;
+    for (auto& slot : result.slots) {
+      slot = perfect_hash_table<num_slots>::empty_slot;
+    }
+    bool collision = false;
+    for (size_t i = 0; i < N && !collision; i++) {
+      uint8_t& slot = result.slots[perfect_hash_name(table[i].name, seed) & (num_slots - 1)];
+      collision = slot != perfect_hash_table<num_slots>::empty_slot;
+      slot = i;
+    }
+    if (!collision) {
+      return result;
+    }
+  }
+  result.seed = UINT32_MAX;
+  return result;
+}
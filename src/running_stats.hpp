@@ -1,5 +1,9 @@
 #pragma once
+#include <math.h>
+
 #include "config_values.hpp"
+#include "kalman.hpp"
+#include "sprt.hpp"
 
 // #ifdef __cplusplus
 // extern "C"
@@ -14,12 +18,24 @@ class running_stats {
  public:
   value_t threshold = 0;
   sum_t sum = 0;
+  // for the variance, 64 bits because squares of 12 bit values overflow quickly
+  uint64_t sum_sq = 0;
   count_t count_above_threshold = 0;
   count_t count_below_threshold = 0;
   float iir_filter_value = -1;
+  // only fed while filter_type is FILTER_TYPE_SPRT/FILTER_TYPE_KALMAN, see sprt.hpp and kalman.hpp
+  sprt_detector sprt;
+  kalman_tracker kalman;
+  value_t min_value = INT16_MAX;
+  value_t max_value = INT16_MIN;
+  // samples where the pin timed out or never discharged, counted by the sampling loop
+  count_t saturated_count = 0;
 
   inline void add_value(value_t v) {
     sum += v;
+    sum_sq += (uint32_t)(v * v);
+    min_value = MIN(min_value, v);
+    max_value = MAX(max_value, v);
     if (v > threshold) {
       count_above_threshold++;
     } else {
@@ -28,18 +44,42 @@ class running_stats {
     if (iir_filter_value < 0) {
       iir_filter_value = (float)v;
     } else {
-      iir_filter_value = iir_filter_b * ((float)v) + (1.0 - iir_filter_b) * iir_filter_value;
+      // single precision, this runs per sample (in an interrupt with TOUCH_POLLING_IRQ)
+      iir_filter_value = iir_filter_b * ((float)v) + (1.0f - iir_filter_b) * iir_filter_value;
     }
   }
 
+  // add the samples of another window (the IIR filter, SPRT and kalman states are left alone, since they only depend
+  // on the latest one)
+  inline void merge(const running_stats& other) {
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+    count_above_threshold += other.count_above_threshold;
+    count_below_threshold += other.count_below_threshold;
+    min_value = MIN(min_value, other.min_value);
+    max_value = MAX(max_value, other.max_value);
+    saturated_count += other.saturated_count;
+  }
+
   inline count_t get_total_count() const { return count_above_threshold + count_below_threshold; }
 
   inline value_t get_mean() const { return sum / (count_above_threshold + count_below_threshold); }
 
   inline float get_mean_float() const { return (float)sum / (float)(count_above_threshold + count_below_threshold); }
 
+  inline float get_stddev() const {
+    float mean = get_mean_float();
+    return sqrtf(MAX((float)sum_sq / get_total_count() - mean * mean, 0.0f));
+  }
+
   inline float get_iir_filtered_value() const { return iir_filter_value; }
 
+  // the value that filter_type compares against the threshold (the median filter only counts samples, so it uses
+  // the mean)
+  inline float get_filtered_value(int filter_type) const {
+    return filter_type == FILTER_TYPE_IIR ? get_iir_filtered_value() : get_mean_float();
+  }
+
   inline bool is_above_threshold() const { return count_above_threshold >= count_below_threshold; }
   inline bool median_is_above_threshold() const { return count_above_threshold >= count_below_threshold; }
   inline bool avg_is_above_threshold() const { return get_mean_float() >= threshold; }
@@ -71,6 +111,25 @@ class running_stats {
   }
 
   inline void reset() { *this = running_stats(); }
+
+  // the state that spans windows (the IIR filter, the SPRT detector and the kalman filter)
+  inline void carry_over_from(const running_stats& previous) {
+    iir_filter_value = previous.iir_filter_value;
+    sprt = previous.sprt;
+    kalman = previous.kalman;
+  }
+
+  // start accumulating the next window in place, the IIR, SPRT and kalman filters carry on from the previous one
+  inline void start_window(value_t new_threshold) {
+    float iir = iir_filter_value;
+    sprt_detector detector = sprt;
+    kalman_tracker tracker = kalman;
+    *this = running_stats();
+    threshold = new_threshold;
+    iir_filter_value = iir;
+    sprt = detector;
+    kalman = tracker;
+  }
 };
 
 // #ifdef __cplusplus
@@ -0,0 +1,110 @@
+#include <math.h>
+
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+#include "custom_logging.hpp"
+#include "sensor_counters.hpp"
+#include "touch_decision.hpp"
+#include "touch_sensor_thread.hpp"
+
+// only touched by core1
+static sensor_counters_t counters[num_touch_sensors];
+static uint64_t counters_start_us = 0;
+static uint64_t last_update_us = 0;
+static bool prev_active[num_touch_sensors] = {false};
+
+// core0 -> core1 requests, core1 clears them once handled
+static volatile bool snapshot_requested = false;
+static volatile bool reset_requested = false;
+static sensor_counters_snapshot_t snapshot_buf;
+
+void __time_critical_func(update_sensor_counters)(const std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                   uint64_t timestamp_us) {
+  if (reset_requested || counters_start_us == 0) {
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      counters[i] = sensor_counters_t();
+    }
+    counters_start_us = timestamp_us;
+    last_update_us = timestamp_us;
+    reset_requested = false;
+  }
+
+  uint64_t elapsed_us = timestamp_us - last_update_us;
+  last_update_us = timestamp_us;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    const running_stats& s = by_sensor[i];
+    sensor_counters_t& c = counters[i];
+    c.samples += s.get_total_count();
+    c.sum += s.sum;
+    c.sum_sq += s.sum_sq;
+    c.min_value = MIN(c.min_value, s.min_value);
+    c.max_value = MAX(c.max_value, s.max_value);
+    c.saturated += s.saturated_count;
+    if (sensor_currently_active[i] != prev_active[i]) {
+      c.transitions++;
+      prev_active[i] = sensor_currently_active[i];
+    }
+    if (sensor_currently_active[i]) {
+      c.pressed_us += elapsed_us;
+    }
+  }
+
+  if (snapshot_requested) {
+    snapshot_buf.start_us = counters_start_us;
+    snapshot_buf.end_us = timestamp_us;
+    memcpy(snapshot_buf.by_sensor, counters, sizeof(counters));
+    // make sure the copy is visible to core0 before it sees the flag
+    __dmb();
+    snapshot_requested = false;
+  }
+}
+
+bool get_sensor_counters_snapshot(sensor_counters_snapshot_t& snapshot, uint64_t timeout_us) {
+  snapshot_requested = true;
+  uint64_t deadline = time_us_64() + timeout_us;
+  while (snapshot_requested) {
+    if (time_us_64() > deadline) {
+      snapshot_requested = false;
+      return false;
+    }
+  }
+  __dmb();
+  snapshot = snapshot_buf;
+  return true;
+}
+
+void reset_sensor_counters() {
+  reset_requested = true;
+}
+
+void print_sensor_counters(uint8_t itf) {
+  // too big for the stack
+  static sensor_counters_snapshot_t snapshot;
+  if (!get_sensor_counters_snapshot(snapshot, 100 * 1000)) {
+    CDC_PUTS(itf, "no response from the sensor thread");
+    return;
+  }
+  float elapsed_s = (snapshot.end_us - snapshot.start_us) * 1.0e-6f;
+  if (elapsed_s <= 0) {
+    CDC_PUTS(itf, "no samples yet");
+    return;
+  }
+  CDC_PRINTF(itf, "over the last %.1f s:\r\n", elapsed_s);
+  CDC_PUTS(itf, "sensor  btn  samples/s     mean   min   max  stddev  baseline  threshold  saturated  transitions/min  pressed_s");
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    const sensor_counters_t& c = snapshot.by_sensor[i];
+    float mean = 0;
+    float stddev = 0;
+    if (c.samples) {
+      mean = (float)c.sum / c.samples;
+      stddev = sqrtf(MAX((float)c.sum_sq / c.samples - mean * mean, 0.0f));
+    }
+    CDC_PRINTF(itf, "%6u  %3s  %9.0f  %7.1f  %4d  %4d  %6.2f  %8.1f  %9u  %9lu  %15.1f  %9.2f\r\n", i,
+               game_button_short_labels[touch_sensor_configs[i].button], c.samples / elapsed_s, mean,
+               c.samples ? c.min_value : 0, c.samples ? c.max_value : 0, stddev, touch_sensor_baseline[i],
+               touch_sensor_thresholds[i], c.saturated, c.transitions * 60.0f / elapsed_s, c.pressed_us * 1.0e-6f);
+  }
+  CDC_FLUSH(itf);
+}
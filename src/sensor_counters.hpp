@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+
+#include "running_stats.hpp"
+#include "touch_sensor_config.hpp"
+
+// cumulative per-sensor counters, kept by core1 since boot (or the last `stats reset`)
+struct sensor_counters_t {
+  uint64_t samples = 0;
+  uint64_t sum = 0;
+  uint64_t sum_sq = 0;
+  value_t min_value = INT16_MAX;
+  value_t max_value = INT16_MIN;
+  uint32_t saturated = 0;
+  // press/release transitions after debounce
+  uint32_t transitions = 0;
+  uint64_t pressed_us = 0;
+};
+
+struct sensor_counters_snapshot_t {
+  uint64_t start_us;
+  uint64_t end_us;
+  sensor_counters_t by_sensor[num_touch_sensors];
+};
+
+// called by core1 after the decisions for each sampling (sub-)window
+void update_sensor_counters(const std::array<running_stats, num_touch_sensors>& by_sensor, uint64_t timestamp_us);
+
+// ask core1 for a copy of the counters, waits up to timeout_us. returns false if core1 didn't respond
+bool get_sensor_counters_snapshot(sensor_counters_snapshot_t& snapshot, uint64_t timeout_us);
+// ask core1 to zero the counters
+void reset_sensor_counters();
+
+// print the `stats` console command output
+void print_sensor_counters(uint8_t itf);
@@ -0,0 +1,89 @@
+#include "tusb.h"
+
+#include "pico/stdlib.h"
+
+#include "config_values.hpp"
+#include "custom_logging.hpp"
+#include "multicore_ipc.h"
+#include "sensor_health.hpp"
+#include "touch_sensor_thread.hpp"
+
+volatile uint8_t sensor_health_faults[num_touch_sensors] = {0};
+volatile uint32_t sensor_health_fault_events[num_touch_sensors] = {0};
+volatile uint32_t sensor_health_saturated_samples[num_touch_sensors] = {0};
+
+// consecutive windows with/without a suspicious reading
+static uint32_t bad_windows[num_touch_sensors] = {0};
+static uint32_t good_windows[num_touch_sensors] = {0};
+// faults seen in the current run of bad windows
+static uint8_t pending_faults[num_touch_sensors] = {0};
+
+static uint8_t check_window(uint i, const running_stats& s) {
+  uint8_t faults = SENSOR_HEALTH_OK;
+  count_t total = s.get_total_count();
+  if (total == 0) {
+    return faults;
+  }
+  if (s.saturated_count * 2 > total) {
+    faults |= SENSOR_HEALTH_SATURATED;
+  }
+  // need a few samples before a flat line means anything
+  if (total >= 4 && s.min_value == s.max_value) {
+    faults |= SENSOR_HEALTH_FLATLINE;
+  }
+  if (health_baseline_jump > 0 && s.get_mean_float() < touch_sensor_baseline[i] - health_baseline_jump) {
+    faults |= SENSOR_HEALTH_BASELINE_JUMP;
+  }
+  return faults;
+}
+
+void __time_critical_func(update_sensor_health)(const std::array<running_stats, num_touch_sensors>& by_sensor) {
+  bool any_faulty_before = false;
+  bool any_faulty_after = false;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    sensor_health_saturated_samples[i] += by_sensor[i].saturated_count;
+    any_faulty_before = any_faulty_before || !sensor_is_healthy(i);
+
+    if (!health_monitor_enabled) {
+      sensor_health_faults[i] = SENSOR_HEALTH_OK;
+      bad_windows[i] = good_windows[i] = 0;
+      continue;
+    }
+
+    uint8_t faults = check_window(i, by_sensor[i]);
+    if (faults) {
+      pending_faults[i] |= faults;
+      good_windows[i] = 0;
+      if (++bad_windows[i] >= health_fault_windows && sensor_is_healthy(i)) {
+        sensor_health_faults[i] = pending_faults[i];
+        sensor_health_fault_events[i]++;
+      }
+    } else {
+      bad_windows[i] = 0;
+      pending_faults[i] = SENSOR_HEALTH_OK;
+      // recovering takes just as long as failing, so a flaky wire doesn't flicker in and out
+      if (++good_windows[i] >= health_fault_windows) {
+        sensor_health_faults[i] = SENSOR_HEALTH_OK;
+      }
+    }
+    any_faulty_after = any_faulty_after || !sensor_is_healthy(i);
+  }
+
+  if (any_faulty_before != any_faulty_after) {
+    blink_interval_t blink = any_faulty_after ? BLINK_SENSOR_FAULT : BLINK_SENSORS_OK;
+    queue_try_add(&q_blink_interval, &blink);
+  }
+}
+
+void print_sensor_health(uint8_t itf) {
+  CDC_PUTS(itf, "sensor  btn  pin  status     faults  saturated_samples");
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    uint8_t faults = sensor_health_faults[i];
+    CDC_PRINTF(itf, "%6u  %3s  %3u  %-9s  %6lu  %17lu  %s%s%s\r\n", i,
+               game_button_short_labels[touch_sensor_configs[i].button], touch_sensor_configs[i].pin,
+               faults ? "EXCLUDED" : "ok", sensor_health_fault_events[i], sensor_health_saturated_samples[i],
+               (faults & SENSOR_HEALTH_SATURATED) ? "saturated " : "", (faults & SENSOR_HEALTH_FLATLINE) ? "flatline " : "",
+               (faults & SENSOR_HEALTH_BASELINE_JUMP) ? "baseline-jump" : "");
+  }
+  CDC_FLUSH(itf);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+
+#include "running_stats.hpp"
+#include "touch_sensor_config.hpp"
+
+// bits of sensor_health_faults
+enum sensor_health_fault : uint8_t {
+  SENSOR_HEALTH_OK = 0,
+  // most samples timed out or never discharged (broken or shorted wire)
+  SENSOR_HEALTH_SATURATED = 1 << 0,
+  // every sample in the window had exactly the same value, a live sensor always has some noise
+  SENSOR_HEALTH_FLATLINE = 1 << 1,
+  // the mean dropped far below the baseline, which a press never does
+  SENSOR_HEALTH_BASELINE_JUMP = 1 << 2,
+};
+
+// written by core1, faults of sensors that are currently excluded (0 when healthy)
+extern volatile uint8_t sensor_health_faults[num_touch_sensors];
+// number of times each sensor has been marked faulty since boot
+extern volatile uint32_t sensor_health_fault_events[num_touch_sensors];
+// total number of saturated samples of each sensor since boot
+extern volatile uint32_t sensor_health_saturated_samples[num_touch_sensors];
+
+// called by core1 for every sampling (sub-)window
+void update_sensor_health(const std::array<running_stats, num_touch_sensors>& by_sensor);
+
+inline bool sensor_is_healthy(uint i) {
+  return sensor_health_faults[i] == SENSOR_HEALTH_OK;
+}
+
+// print the health of every sensor to the console
+void print_sensor_health(uint8_t itf);
@@ -1,137 +1,266 @@
+#include <algorithm>
 #include <charconv>
-#include <string>
-#include <variant>
+#include <climits>
+#include <string_view>
 
 #include "hardware/flash.h"
 #include "pico/stdlib.h"
 
 #include "tusb.h"
 
+#include "autotune.hpp"
+#include "bench.hpp"
+#include "button_events.hpp"
 #include "config_defines.h"
 #include "custom_logging.hpp"
+#include "perfect_hash.hpp"
+#include "sensor_counters.hpp"
+#include "sensor_health.hpp"
 #include "serial_config_console.hpp"
+#include "touch_decision.hpp"
 #include "touch_sensor_config.hpp"
 #include "touch_sensor_thread.hpp"
 #include "reset_interface.h"
 
-#ifndef DEFAULT_THRESHOLD_FACTOR
-#define DEFAULT_THRESHOLD_FACTOR 1.5
-#endif  // DEFAULT_THRESHOLD_FACTOR
-#ifndef DEFAULT_THRESHOLD_VALUE
-#define DEFAULT_THRESHOLD_VALUE 150.0
-#endif  // DEFAULT_THRESHOLD_VALUE
-
-float threshold_factor = DEFAULT_THRESHOLD_FACTOR;
-float threshold_value = DEFAULT_THRESHOLD_VALUE;
-int threshold_type = THRESHOLD_TYPE_VALUE;
-uint64_t threshold_sampling_duration_us = 2 * 1000 * 1000;
-uint64_t sampling_duration_us = 1 * 1000;
-uint64_t serial_teleplot_report_interval_us = 80 * 1000;
-bool teleplot_normalize_values = true;
-int filter_type = FILTER_TYPE_MEDIAN;
-bool usb_hid_enabled = true;
-float iir_filter_b = 0.8;
-uint64_t sleep_us_between_samples = 0;
-uint64_t debounce_us = 10000; // 10ms
-float hysteresis = 50.0;
-
-static config_console_value config_values[] = {
-    {"threshold_factor", &threshold_factor},
-    {"threshold_value", &threshold_value},
+static constexpr config_console_value config_values[] = {
+    {"threshold_factor", threshold_factor.data(), num_touch_sensors},
+    {"threshold_value", threshold_value.data(), num_touch_sensors},
     {"threshold_type", &threshold_type},
     {"threshold_sampling_duration_us", &threshold_sampling_duration_us},
     {"sampling_duration_us", &sampling_duration_us},
+    {"sys_clock_khz", &sys_clock_khz},
+    {"touch_accum_shift", &touch_accum_shift},
+    {"sliding_window_subwindows", &sliding_window_subwindows},
+    {"adaptive_window_enabled", &adaptive_window_enabled},
+    {"adaptive_window_min_us", &adaptive_window_min_us},
+    {"adaptive_window_max_us", &adaptive_window_max_us},
+    {"adaptive_window_margin", &adaptive_window_margin},
+    {"sof_sync_enabled", &sof_sync_enabled},
+    {"sof_sync_lead_us", &sof_sync_lead_us},
     {"serial_teleplot_report_interval_us", &serial_teleplot_report_interval_us},
     {"teleplot_normalize_values", &teleplot_normalize_values},
     {"usb_hid_enabled", &usb_hid_enabled},
+    {"low_power_scan_enabled", &low_power_scan_enabled},
+    {"low_power_scan_interval_us", &low_power_scan_interval_us},
+    {"remote_wakeup_hold_us", &remote_wakeup_hold_us},
     {"filter_type", &filter_type},
     {"iir_filter_b", &iir_filter_b},
+    {"sprt_press_confidence", &sprt_press_confidence},
+    {"sprt_release_confidence", &sprt_release_confidence},
+    {"sprt_press_delta", sprt_press_delta.data(), num_touch_sensors},
+    {"sprt_min_samples", &sprt_min_samples},
+    {"kalman_signal_q", &kalman_signal_q},
+    {"kalman_signal_decay_shift", &kalman_signal_decay_shift},
     {"sleep_us_between_samples", &sleep_us_between_samples},
-    {"debounce_us", &debounce_us},
-    {"hysteresis", &hysteresis},
+    {"debounce_us", debounce_us.data(), num_touch_sensors},
+    {"hysteresis", hysteresis.data(), num_touch_sensors},
+    {"health_monitor_enabled", &health_monitor_enabled},
+    {"health_fault_windows", &health_fault_windows},
+    {"health_baseline_jump", &health_baseline_jump},
+    {"fusion_type", &fusion_type},
+    {"fusion_weight", fusion_weight.data(), num_touch_sensors},
+    {"common_mode_rejection", &common_mode_rejection},
+    {"crosstalk", crosstalk.data(), crosstalk.size()},
+    {"autotune_idle_sigmas", &autotune_idle_sigmas},
+    {"autotune_record_duration_us", &autotune_record_duration_us},
 };
 
+static constexpr auto config_values_hash = make_perfect_hash_table<128>(config_values);
+static_assert(config_values_hash.valid(), "no perfect hash seed found for config_values, increase the table size");
+
+// split off the first word of args (separated by spaces)
+static std::string_view next_word(std::string_view& args) {
+  size_t start = args.find_first_not_of(' ');
+  if (start == std::string_view::npos) {
+    args = {};
+    return {};
+  }
+  args.remove_prefix(start);
+  size_t end = std::min(args.find(' '), args.size());
+  std::string_view word = args.substr(0, end);
+  args.remove_prefix(end);
+  return word;
+}
+
 // #if SERIAL_CONFIG_CONSOLE
 
-void erase_saved_config_in_flash();
-bool write_config_to_flash();
-bool read_config_from_flash();
+struct console_command {
+  std::string_view name;
+  void (*handler)(uint8_t itf, std::string_view args);
+  const char* help;
+};
+
+static void print_help(uint8_t itf, std::string_view args);
+
+static void list_config_values(uint8_t itf, std::string_view args) {
+  CDC_PUTS(itf, "config values:");
+  for (uint i = 0; i < count_of(config_values); i++) {
+    config_values[i].print_config_line(itf);
+  }
+  tud_cdc_n_write_str(itf, "\r\n");
+}
+
+static void print_touch_sensor_thresholds(uint8_t itf, std::string_view args) {
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    CDC_PRINTF(itf, "touch_sensor_thresholds[%i] = %i\r\n", i, touch_sensor_thresholds[i]);
+  }
+}
+
+static void set_config_value(uint8_t itf, std::string_view args) {
+  std::string_view name = next_word(args);
+  std::string_view value_str = next_word(args);
+
+  // split off the optional index, as in `threshold_value[3]`. only the bare name sets every element
+  int index = -1;
+  size_t index_start = name.find('[');
+  if (index_start != std::string_view::npos) {
+    std::string_view index_str = name.substr(index_start + 1);
+    name = name.substr(0, index_start);
+    unsigned parsed;
+    const char* last = index_str.data() + index_str.size();
+    std::from_chars_result fcr = std::from_chars(index_str.data(), last, parsed);
+    // digits only (no sign), then a closing ] and nothing after it
+    if (fcr.ec != std::errc{} || fcr.ptr != last - 1 || *fcr.ptr != ']') {
+      CDC_PRINTF(itf, "invalid index: [%.*s\r\n", (int)index_str.size(), index_str.data());
+      return;
+    }
+    index = MIN(parsed, (unsigned)INT_MAX);
+  }
+
+  int i = config_values_hash.find(config_values, name);
+  if (i < 0) {
+    CDC_PRINTF(itf, "config value not found: %.*s\r\n", (int)name.size(), name.data());
+  } else if (index >= (int)config_values[i].count || (index >= 0 && config_values[i].count == 1)) {
+    CDC_PRINTF(itf, "index out of range: %d\r\n", index);
+  } else {
+    config_values[i].read_str(itf, value_str, index);
+  }
+}
+
+static void save_config(uint8_t itf, std::string_view args) {
+  CDC_PUTS(itf, write_config_to_flash() ? "success" : "fail");
+}
+
+static void load_config(uint8_t itf, std::string_view args) {
+  CDC_PUTS(itf, read_config_from_flash() ? "success" : "fail");
+}
+
+static void reset_config(uint8_t itf, std::string_view args) {
+  erase_saved_config_in_flash();
+  CDC_PUTS(itf, "unplug and replug to complete the config reset");
+}
+
+static void sensor_stats(uint8_t itf, std::string_view args) {
+  if (next_word(args) == "reset") {
+    reset_sensor_counters();
+    CDC_PUTS(itf, "stats reset");
+  } else {
+    print_sensor_counters(itf);
+  }
+}
+
+static void sensor_health(uint8_t itf, std::string_view args) {
+  print_sensor_health(itf);
+}
+
+static void start_autotune(uint8_t itf, std::string_view args) {
+  autotune_start(itf);
+}
+
+static void calibrate(uint8_t itf, std::string_view args) {
+  touch_recalibration_requested = true;
+  CDC_PUTS(itf, "re-measuring sensor baselines, don't touch the pad");
+}
+
+static void run_bench(uint8_t itf, std::string_view args) {
+  if (bench_is_active()) {
+    CDC_PUTS(itf, "benchmark already running");
+    return;
+  }
+  if (next_word(args) == "ops") {
+    bench_ops_start(itf);
+  } else {
+    bench_start(itf);
+  }
+}
+
+static void show_button_events(uint8_t itf, std::string_view args) {
+  std::string_view mode = next_word(args);
+  if (mode == "follow") {
+    follow_button_events(itf, true);
+  } else if (mode == "stop") {
+    follow_button_events(itf, false);
+  } else {
+    print_button_events(itf);
+  }
+}
+
+static void reboot_to_flash(uint8_t itf, std::string_view args) {
+  CDC_PUTS(itf, "rebooting into bootloader for firmware update");
+  CDC_FLUSH(itf);
+  reboot_to_uf2_bootloader();
+}
+
+static constexpr console_command console_commands[] = {
+    {"help", print_help, nullptr},
+    {"?", print_help, nullptr},
+    {"list", list_config_values, "list            - print out all config elements and their values"},
+    {"touch_sensor_thresholds", print_touch_sensor_thresholds, nullptr},
+    {"set", set_config_value, "set NAME VALUE  - set config element NAME to VALUE (for per-sensor values, sets all sensors)\r\n"
+                              "set NAME[I] VALUE - set per-sensor config element NAME for sensor I to VALUE"},
+    {"save", save_config, "save            - save current config values to flash storage (they will persist after it is unplugged)"},
+    {"load", load_config, "load            - load config values from flash storage"},
+    {"reset", reset_config, "reset           - erase the config values in flash storage, so you can revert to defaults"},
+    {"flash", reboot_to_flash, "flash           - enter firmware update mode by rebooting into the UF2 bootloader"},
+    {"stats", sensor_stats, "stats           - show per-sensor sample rate, noise and press counters (`stats reset` to zero them)"},
+    {"health", sensor_health, "health          - show which sensors look broken and are excluded from button decisions"},
+    {"autotune", start_autotune, "autotune        - record idle and pressed values for each sensor, then pick and save thresholds"},
+    {"calibrate", calibrate, "calibrate       - re-measure the untouched value of each sensor"},
+    {"events", show_button_events, "events          - print the recent button presses/releases as CSV (`events follow` to keep printing new ones, `events stop`)"},
+    {"bench", run_bench, "bench           - measure sample rate jitter with USB idle and under heavy console output\r\n"
+                         "bench ops       - time the running_stats methods and filters per sample (CSV output)"},
+};
+static constexpr auto console_commands_hash = make_perfect_hash_table<32>(console_commands);
+static_assert(console_commands_hash.valid(), "no perfect hash seed found for console_commands, increase the table size");
+
+static void print_help(uint8_t itf, std::string_view args) {
+  CDC_PUTS(itf, "commands:");
+  for (const console_command& command : console_commands) {
+    if (command.help) {
+      CDC_PUTS(itf, command.help);
+    }
+  }
+}
 
 void serial_console_task() {
   constexpr uint8_t itf = SERIAL_CONFIG_CONSOLE_INTERFACE;
-  static std::string line_buf;
+  static console_line line;
 
   if (!CDC_IS_CONNECTED(itf)) {
     return;
   }
 
-  if (read_line_into_string(itf, line_buf)) {
-    // CDC_PRINTF(itf, "line: %s\r\n",
-    //            line_buf.c_str());
-    if (line_buf.empty()) {
+  if (read_line(itf, line)) {
+    if (autotune_is_active()) {
+      autotune_handle_line(itf, line.view());
+      line.clear();
+      return;
+    }
+
+    std::string_view args = line.view();
+    std::string_view name = next_word(args);
+    if (line.overflowed) {
+      CDC_PRINTF(itf, "line too long (max %u characters)\r\n", (uint)console_line::max_length);
+    } else if (name.empty()) {
       // do nothing
-    } else if (line_buf.rfind("help") == 0 || line_buf.rfind("?") == 0) {
-      CDC_PUTS(itf, "commands:");
-      CDC_PUTS(itf, "list            - print out all config elements and their values");
-      CDC_PUTS(itf, "set NAME VALUE  - set config element NAME to VALUE");
-      CDC_PUTS(itf, "save            - save current config values to flash storage (they will persist after it is unplugged)");
-      CDC_PUTS(itf, "load            - load config values from flash storage");
-      CDC_PUTS(itf, "reset           - erase the config values in flash storage, so you can revert to defaults");
-      CDC_PUTS(itf, "flash           - enter firmware update mode by rebooting into the UF2 bootloader");
-
-    } else if (line_buf.rfind("list") == 0) {
-      CDC_PUTS(itf, "config values:");
-      for (uint i = 0; i < count_of(config_values); i++) {
-        config_values[i].print_config_line(itf);
-      }
-      tud_cdc_n_write_str(itf, "\r\n");
-    } else if (line_buf.rfind("touch_sensor_thresholds") == 0) {
-      for (uint i = 0; i < num_touch_sensors; i++) {
-        CDC_PRINTF(itf, "touch_sensor_thresholds[%i] = %i\r\n", i, touch_sensor_thresholds[i]);
-      }
-    } else if (line_buf.rfind("set ") == 0) {
-      char name_buf[128] = {0};
-      char value_buf[128] = {0};
-      sscanf(line_buf.c_str(), "set %128s %128s", name_buf, value_buf);
-      std::string value_str(value_buf);
-
-      bool found = false;
-      for (uint i = 0; i < count_of(config_values); i++) {
-        if (config_values[i].name == name_buf) {
-          config_values[i].read_str(itf, value_str);
-          found = true;
-          break;
-        }
-      }
-      if (!found) {
-        // CDC_PUTS(itf, "config value not found");
-        CDC_PRINTF(itf, "config value not found: %s\r\n", name_buf);
-      }
-    } else if (line_buf.rfind("save") == 0) {
-      if (write_config_to_flash()) {
-        CDC_PUTS(itf, "success");
-      } else {
-        CDC_PUTS(itf, "fail");
-      }
-    } else if (line_buf.rfind("load") == 0) {
-      if (read_config_from_flash()) {
-        CDC_PUTS(itf, "success");
-      } else {
-        CDC_PUTS(itf, "fail");
-      }
-    } else if (line_buf.rfind("reset") == 0) {
-      erase_saved_config_in_flash();
-      CDC_PUTS(itf, "unplug and replug to complete the config reset");
-    } else if (line_buf.rfind("flash") == 0) {
-      CDC_PUTS(itf, "rebooting into bootloader for firmware update");
-      CDC_FLUSH(itf);
-      reboot_to_uf2_bootloader();
+    } else if (int i = console_commands_hash.find(console_commands, name); i >= 0) {
+      console_commands[i].handler(itf, args);
     } else {
-      CDC_PRINTF(itf, "command not recognized: %s\r\n", line_buf.c_str());
+      CDC_PRINTF(itf, "command not recognized: %.*s\r\n", (int)line.length, line.buf);
     }
 
     // clear the line to reset state
-    line_buf.clear();
+    line.clear();
     // re-print the command prompt
     tud_cdc_n_write_str(itf, "> ");
     CDC_FLUSH(itf);
@@ -142,52 +271,63 @@ void serial_console_task() {
 // inline void serial_console_task(void);
 // #endif
 
-const void config_console_value::print_config_line(uint8_t itf) {
-  CDC_PRINTF(itf, "-- %-40s: ", name.c_str());
-  if (0) {
-  } else if (value_float) {
-    CDC_PRINTF(itf, "(float)    %f\r\n", *value_float);
-  } else if (value_uint64_t) {
-    CDC_PRINTF(itf, "(uint64_t) %llu\r\n", *value_uint64_t);
-  } else if (value_int) {
-    CDC_PRINTF(itf, "(int)      %d\r\n", *value_int);
-  } else if (value_bool) {
-    CDC_PRINTF(itf, "(bool)     %d\r\n", *value_bool);
-  } else {
-    CDC_PUTS(itf, "<invalid type>");
+void config_console_value::print_config_line(uint8_t itf) const {
+  for (size_t i = 0; i < count; i++) {
+    if (count == 1) {
+      CDC_PRINTF(itf, "-- %-40.*s: ", (int)name.size(), name.data());
+    } else {
+      char indexed_name[48];
+      snprintf(indexed_name, sizeof(indexed_name), "%.*s[%u]", (int)name.size(), name.data(), i);
+      CDC_PRINTF(itf, "-- %-40s: ", indexed_name);
+    }
+    if (0) {
+    } else if (value_float) {
+      CDC_PRINTF(itf, "(float)    %f\r\n", value_float[i]);
+    } else if (value_uint64_t) {
+      CDC_PRINTF(itf, "(uint64_t) %llu\r\n", value_uint64_t[i]);
+    } else if (value_int) {
+      CDC_PRINTF(itf, "(int)      %d\r\n", value_int[i]);
+    } else if (value_bool) {
+      CDC_PRINTF(itf, "(bool)     %d\r\n", value_bool[i]);
+    } else {
+      CDC_PUTS(itf, "<invalid type>");
+    }
   }
   CDC_FLUSH(itf);
 }
 
-const bool config_console_value::read_str(uint8_t itf, const std::string& value_str) {
-  const char* first = value_str.c_str();
-  const char* last = value_str.c_str() + value_str.size();
+bool config_console_value::read_str(uint8_t itf, std::string_view value_str, int index) const {
+  const char* first = value_str.data();
+  const char* last = value_str.data() + value_str.size();
+  // index -1 (the bare name) sets every element
+  const size_t begin = index < 0 ? 0 : index;
+  const size_t end = index < 0 ? count : index + 1;
   std::from_chars_result fcr;
   if (0) {
   } else if (value_float) {
     float value_float2;
     fcr = std::from_chars(first, last, value_float2);
     if (fcr.ec == std::errc{}) {
-      *value_float = value_float2;
+      std::fill(value_float + begin, value_float + end, value_float2);
     }
   } else if (value_uint64_t) {
     uint64_t value_uint64_t2;
     fcr = std::from_chars(first, last, value_uint64_t2);
     if (fcr.ec == std::errc{}) {
-      *value_uint64_t = value_uint64_t2;
+      std::fill(value_uint64_t + begin, value_uint64_t + end, value_uint64_t2);
     }
   } else if (value_int) {
     int value_int2;
     fcr = std::from_chars(first, last, value_int2);
     if (fcr.ec == std::errc{}) {
-      *value_int = value_int2;
+      std::fill(value_int + begin, value_int + end, value_int2);
     }
   } else if (value_bool) {
     // TODO: better/easier bool format?
     int value_bool2;
     fcr = std::from_chars(first, last, value_bool2);
     if (fcr.ec == std::errc{}) {
-      *value_bool = value_bool2;
+      std::fill(value_bool + begin, value_bool + end, value_bool2);
     }
   } else {
     CDC_PUTS(itf, "<invalid type>");
@@ -197,32 +337,34 @@ const bool config_console_value::read_str(uint8_t itf, const std::string& value_
     CDC_FLUSH(itf);
     return false;
   }
+  touch_filter_params_dirty = true;
   CDC_FLUSH(itf);
   return true;
 }
 
-const bool config_console_value::read_from_raw(const void* raw_value_ptr) {
+bool config_console_value::read_from_raw(const void* raw_value_ptr, size_t i) const {
   if (0) {
     // clang-format off
-  } else if (value_float   ) { *value_float    = *((float    *) raw_value_ptr);
-  } else if (value_uint64_t) { *value_uint64_t = *((uint64_t *) raw_value_ptr);
-  } else if (value_int     ) { *value_int      = *((int      *) raw_value_ptr);
-  } else if (value_bool    ) { *value_bool     = *((bool     *) raw_value_ptr);
+  } else if (value_float   ) { value_float[i]    = *((float    *) raw_value_ptr);
+  } else if (value_uint64_t) { value_uint64_t[i] = *((uint64_t *) raw_value_ptr);
+  } else if (value_int     ) { value_int[i]      = *((int      *) raw_value_ptr);
+  } else if (value_bool    ) { value_bool[i]     = *((bool     *) raw_value_ptr);
     // clang-format on
   } else {
     // TODO: error handling?
     return false;
   }
+  touch_filter_params_dirty = true;
   return true;
 }
 
-const bool config_console_value::write_to_raw(void* raw_value_ptr) {
+bool config_console_value::write_to_raw(void* raw_value_ptr, size_t i) const {
   if (0) {
     // clang-format off
-  } else if (value_float   ) {*((float    *) raw_value_ptr) = *value_float    ;
-  } else if (value_uint64_t) {*((uint64_t *) raw_value_ptr) = *value_uint64_t ;
-  } else if (value_int     ) {*((int      *) raw_value_ptr) = *value_int      ;
-  } else if (value_bool    ) {*((bool     *) raw_value_ptr) = *value_bool     ;
+  } else if (value_float   ) {*((float    *) raw_value_ptr) = value_float[i]    ;
+  } else if (value_uint64_t) {*((uint64_t *) raw_value_ptr) = value_uint64_t[i] ;
+  } else if (value_int     ) {*((int      *) raw_value_ptr) = value_int[i]      ;
+  } else if (value_bool    ) {*((bool     *) raw_value_ptr) = value_bool[i]     ;
     // clang-format on
   } else {
     // TODO: error handling?
@@ -232,10 +374,10 @@ const bool config_console_value::write_to_raw(void* raw_value_ptr) {
 }
 
 /**
- * when return value is true, line_buf contains line that was read (without
+ * when return value is true, line contains the line that was read (without
  * trailing '\n' or '\r')
  */
-bool read_line_into_string(uint8_t itf, std::string& line_buf, bool echo_mid_line) {
+bool read_line(uint8_t itf, console_line& line, bool echo_mid_line) {
   if (tud_cdc_n_available(itf)) {
     while (true) {
       int32_t ich = tud_cdc_n_read_char(itf);
@@ -256,7 +398,12 @@ bool read_line_into_string(uint8_t itf, std::string& line_buf, bool echo_mid_lin
         return true;
       }
 
-      line_buf.push_back(ich);
+      if (line.length < console_line::max_length) {
+        line.buf[line.length++] = ich;
+        line.buf[line.length] = '\0';
+      } else {
+        line.overflowed = true;
+      }
     }
   }
   return false;
@@ -270,15 +417,17 @@ void serial_console_init() {
   }
 }
 
-constexpr uint64_t current_config_version = 1;
+constexpr uint64_t current_config_version = 2;
 
 struct flash_config_header {
   uint64_t version;
   uint64_t num_config_values;
 };
 
-// constexpr size_t flash_page_size_words = FLASH_PAGE_SIZE / sizeof(uint64_t);
-constexpr size_t max_flash_config_value_elements = (FLASH_PAGE_SIZE - sizeof(flash_config_header)) / sizeof(uint64_t);
+// per-sensor arrays take one element each, so one page is not enough
+constexpr size_t flash_config_num_pages = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+constexpr size_t flash_config_size = flash_config_num_pages * FLASH_PAGE_SIZE;
+constexpr size_t max_flash_config_value_elements = (flash_config_size - sizeof(flash_config_header)) / sizeof(uint64_t);
 
 struct flash_config {
   flash_config_header header;
@@ -289,22 +438,48 @@ struct flash_config {
 
 const flash_config* flash_config_contents = (const flash_config*)(XIP_BASE + FLASH_TARGET_OFFSET);
 
+size_t num_config_values() {
+  return count_of(config_values);
+}
+const config_console_value& get_config_value(size_t index) {
+  return config_values[index];
+}
+
+// total number of flash elements used by all config values
+static size_t num_config_value_elements() {
+  size_t n = 0;
+  for (size_t i = 0; i < count_of(config_values); i++) {
+    n += config_values[i].count;
+  }
+  return n;
+}
+
 void erase_saved_config_in_flash() {
   flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
 }
 bool write_config_to_flash() {
   flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
 
-  static_assert(sizeof(flash_config) == FLASH_PAGE_SIZE, "config size mismatch");
-  static_assert(count_of(config_values) <= max_flash_config_value_elements, "too many config values!");
+  static_assert(sizeof(flash_config) == flash_config_size, "config size mismatch");
+  static_assert(flash_config_size <= FLASH_SECTOR_SIZE, "config does not fit in one flash sector");
 
-  flash_config config_to_write;
+  const size_t num_elements = num_config_value_elements();
+  if (num_elements > max_flash_config_value_elements) {
+    return false;
+  }
+
+  // too big for the stack
+  static flash_config config_to_write;
+  memset(&config_to_write, 0, sizeof(config_to_write));
   config_to_write.header.version = current_config_version;
-  config_to_write.header.num_config_values = count_of(config_values);
+  config_to_write.header.num_config_values = num_elements;
+  size_t element_idx = 0;
   for (size_t i = 0; i < count_of(config_values); i++) {
-    void* raw_value_ptr = &config_to_write.config_value_elements[i];
-    if (!config_values[i].write_to_raw(raw_value_ptr)) {
-      return false;
+    for (size_t j = 0; j < config_values[i].count; j++) {
+      void* raw_value_ptr = &config_to_write.config_value_elements[element_idx++];
+      if (!config_values[i].write_to_raw(raw_value_ptr, j)) {
+        return false;
+      }
     }
   }
 
@@ -315,14 +490,17 @@ bool write_config_to_flash() {
 bool read_config_from_flash() {
   if (flash_config_contents->header.version != current_config_version) {
     return false;
-  } else if (flash_config_contents->header.num_config_values != count_of(config_values)) {
+  } else if (flash_config_contents->header.num_config_values != num_config_value_elements()) {
     return false;
   }
 
-  for (size_t i = 0; i < MIN(count_of(config_values), flash_config_contents->header.num_config_values); i++) {
-    const void* raw_value_ptr = &(flash_config_contents->config_value_elements[i]);
-    if (!config_values[i].read_from_raw(raw_value_ptr)) {
-      return false;
+  size_t element_idx = 0;
+  for (size_t i = 0; i < count_of(config_values); i++) {
+    for (size_t j = 0; j < config_values[i].count; j++) {
+      const void* raw_value_ptr = &(flash_config_contents->config_value_elements[element_idx++]);
+      if (!config_values[i].read_from_raw(raw_value_ptr, j)) {
+        return false;
+      }
     }
   }
   return true;
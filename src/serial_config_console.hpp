@@ -1,29 +1,60 @@
 #pragma once
-#include <string>
+#include <string_view>
 #include "config_values.hpp"
 
-bool read_line_into_string(uint8_t itf, std::string& line_buf, bool echo_mid_line = true);
+// fixed size buffer for one line of console input, so reading lines never touches the heap
+struct console_line {
+  static constexpr size_t max_length = 127;
+  char buf[max_length + 1] = {0};
+  size_t length = 0;
+  // characters past max_length were dropped
+  bool overflowed = false;
+
+  std::string_view view() const { return std::string_view(buf, length); }
+  void clear() {
+    length = 0;
+    overflowed = false;
+    buf[0] = '\0';
+  }
+};
+
+bool read_line(uint8_t itf, console_line& line, bool echo_mid_line = true);
 
 void serial_console_init();
 
 void serial_console_task();
 
+void erase_saved_config_in_flash();
+bool write_config_to_flash();
+bool read_config_from_flash();
+
 struct config_console_value {
-  const std::string name;
-  float* value_float = nullptr;
-  uint64_t* value_uint64_t = nullptr;
-  int* value_int = nullptr;
-  bool* value_bool = nullptr;
+  const std::string_view name;
+  float* const value_float = nullptr;
+  uint64_t* const value_uint64_t = nullptr;
+  int* const value_int = nullptr;
+  bool* const value_bool = nullptr;
+  // number of elements, for per-sensor arrays (set with `set NAME[INDEX] VALUE`)
+  const size_t count = 1;
 
  public:
-  config_console_value(const std::string name, float* value_float) : name(name), value_float(value_float) {}
-  config_console_value(const std::string name, uint64_t* value_uint64_t) : name(name), value_uint64_t(value_uint64_t) {}
-  config_console_value(const std::string name, int* value_int) : name(name), value_int(value_int) {}
-  config_console_value(const std::string name, bool* value_bool) : name(name), value_bool(value_bool) {}
+  constexpr config_console_value(std::string_view name, float* value_float, size_t count = 1)
+      : name(name), value_float(value_float), count(count) {}
+  constexpr config_console_value(std::string_view name, uint64_t* value_uint64_t, size_t count = 1)
+      : name(name), value_uint64_t(value_uint64_t), count(count) {}
+  constexpr config_console_value(std::string_view name, int* value_int, size_t count = 1)
+      : name(name), value_int(value_int), count(count) {}
+  constexpr config_console_value(std::string_view name, bool* value_bool, size_t count = 1)
+      : name(name), value_bool(value_bool), count(count) {}
 
-  const void print_config_line(uint8_t itf);
-  const bool read_str(uint8_t itf, const std::string& value_str);
+  void print_config_line(uint8_t itf) const;
+  // when index is negative, every element is set to the same value
+  bool read_str(uint8_t itf, std::string_view value_str, int index = -1) const;
 
-  const bool read_from_raw(const void * raw_value_ptr);
-  const bool write_to_raw(void * raw_value_ptr);
+  bool read_from_raw(const void* raw_value_ptr, size_t index) const;
+  bool write_to_raw(void* raw_value_ptr, size_t index) const;
 };
+
+// for the vendor protocol, indexes are the order of the config values table
+size_t num_config_values();
+const config_console_value& get_config_value(size_t index);
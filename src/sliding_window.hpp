@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+
+#include "config_values.hpp"
+#include "running_stats.hpp"
+#include "touch_sensor_config.hpp"
+
+// the most recent sampling sub-windows of every sensor, published as one window over all of them (see
+// sliding_window_subwindows)
+class sliding_window {
+  std::array<running_stats, num_touch_sensors> ring[MAX_SLIDING_WINDOW_SUBWINDOWS];
+  uint size = 0;
+  uint idx = 0;
+  uint fill = 0;
+  // the most recently committed sub-window, survives resize() so the IIR filter state isn't lost
+  uint newest = 0;
+
+ public:
+  // how many sub-windows a window of duration_us is split into
+  static inline uint num_subwindows(uint64_t duration_us) {
+    uint64_t n = MIN(sliding_window_subwindows, MAX_SLIDING_WINDOW_SUBWINDOWS);
+    // at least sampling_buffer_time_us of sampling in each sub-window, after leaving the buffer out of the window
+    return MAX(1, MIN(n, duration_us / (2 * sampling_buffer_time_us)));
+  }
+
+  inline void resize(uint n) {
+    if (n != size) {
+      size = n;
+      idx = 0;
+      fill = 0;
+    }
+  }
+
+  // forget the older sub-windows, after the next commit() the window is just that one
+  inline void clear() { fill = 0; }
+
+  // like clear(), but the filter states start over too (after a recalibration)
+  inline void reset() {
+    for (uint k = 0; k < MAX_SLIDING_WINDOW_SUBWINDOWS; k++) {
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        ring[k][i].reset();
+      }
+    }
+    fill = 0;
+  }
+
+  // the slot to sample the next sub-window into (see running_stats::start_window), carrying over the filter states of
+  // the newest one. it becomes part of the window with commit()
+  inline std::array<running_stats, num_touch_sensors>& next_subwindow() {
+    std::array<running_stats, num_touch_sensors>& next = ring[idx];
+    if (idx != newest) {
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        next[i].carry_over_from(ring[newest][i]);
+      }
+    }
+    return next;
+  }
+
+  inline void commit() {
+    newest = idx;
+    idx = (idx + 1) % size;
+    fill = MIN(fill + 1, size);
+  }
+
+  // all sub-windows merged into by_sensor, with the filter states of the newest one
+  inline void merged(std::array<running_stats, num_touch_sensors>& by_sensor, const uint16_t* thresholds) const {
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      by_sensor[i].reset();
+      by_sensor[i].threshold = thresholds[i];
+      for (uint k = 0; k < fill; k++) {
+        by_sensor[i].merge(ring[(newest + size - k) % size][i]);
+      }
+      by_sensor[i].carry_over_from(ring[newest][i]);
+    }
+  }
+};
@@ -0,0 +1,82 @@
+#include "config_values.hpp"
+#include "sof_sync.hpp"
+
+constexpr int32_t usb_frame_us = 1000;
+// the estimate creeps later by 1us every this many frames, which tracks up to 125ppm of clock drift between us and
+// the host
+constexpr uint32_t sof_phase_creep_interval_frames = 8;
+
+volatile int32_t usb_sof_phase_us = -1;
+volatile int32_t sof_sync_phase_error_us = 0;
+
+// wrap a phase difference into [-usb_frame_us/2, usb_frame_us/2)
+static inline int32_t wrap_phase(int32_t d) {
+  d %= usb_frame_us;
+  if (d < -usb_frame_us / 2) {
+    d += usb_frame_us;
+  } else if (d >= usb_frame_us / 2) {
+    d -= usb_frame_us;
+  }
+  return d;
+}
+
+/**
+ * tud_sof_cb runs from tud_task, so it's always some amount of main loop latency *after* the real SOF, and never
+ * before it. so the estimate jumps to any earlier observation, and otherwise only creeps later slowly to follow clock
+ * drift.
+ */
+void sof_sync_on_sof(uint64_t now_us) {
+  static uint32_t frames_since_creep = 0;
+  int32_t observed = now_us % usb_frame_us;
+  int32_t phase = usb_sof_phase_us;
+  if (phase < 0) {
+    usb_sof_phase_us = observed;
+    return;
+  }
+  int32_t d = wrap_phase(observed - phase);
+  if (d < 0) {
+    phase = observed;
+    frames_since_creep = 0;
+  } else if (d > 0 && ++frames_since_creep >= sof_phase_creep_interval_frames) {
+    phase = (phase + 1) % usb_frame_us;
+    frames_since_creep = 0;
+  }
+  usb_sof_phase_us = phase;
+}
+
+// time_us_64() % 1000 at which windows should end, ie. the SOF minus the lead time
+static inline int32_t target_phase(int32_t sof_phase) {
+  return ((sof_phase - (int32_t)sof_sync_lead_us) % usb_frame_us + usb_frame_us) % usb_frame_us;
+}
+
+uint64_t sof_sync_window_end_time(uint64_t now_us, uint64_t sample_us) {
+  uint64_t nominal_end = now_us + sample_us;
+  int32_t sof_phase = usb_sof_phase_us;
+  if (!sof_sync_enabled || sof_phase < 0) {
+    return nominal_end;
+  }
+
+  // split each frame into however many windows fit best, or use whole frames for longer windows
+  uint64_t windows_per_frame = sample_us >= usb_frame_us ? 1 : (usb_frame_us + sample_us / 2) / sample_us;
+  uint64_t period = usb_frame_us / windows_per_frame;
+
+  // latest target point (SOF minus lead) at or before the nominal end, then round to the nearest window boundary
+  uint64_t frame_start = nominal_end - (nominal_end + usb_frame_us - target_phase(sof_phase)) % usb_frame_us;
+  uint64_t k = (nominal_end - frame_start + period / 2) / period;
+  uint64_t end = k >= windows_per_frame ? frame_start + usb_frame_us : frame_start + k * period;
+  // rounding down can leave a short window (the first one, or after a pause) with few or no samples at all, take the
+  // next boundary instead
+  uint64_t min_end = now_us + sample_us / 2;
+  if (end <= min_end) {
+    end += period;
+  }
+  return end;
+}
+
+void sof_sync_record_window_end(uint64_t end_us) {
+  int32_t sof_phase = usb_sof_phase_us;
+  if (sof_phase < 0) {
+    return;
+  }
+  sof_sync_phase_error_us = wrap_phase((int32_t)(end_us % usb_frame_us) - target_phase(sof_phase));
+}
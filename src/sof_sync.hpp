@@ -0,0 +1,18 @@
+#pragma once
+#include "pico/stdlib.h"
+
+// phase of the USB start-of-frame within each 1ms frame, as time_us_64() % 1000, or -1 until the first SOF.
+// written by core0, read by core1
+extern volatile int32_t usb_sof_phase_us;
+// how far the end of the last sampling window was from its SOF-aligned target, written by core1
+extern volatile int32_t sof_sync_phase_error_us;
+
+// called by core0 on every SOF
+void sof_sync_on_sof(uint64_t now_us);
+
+// end time of a sampling window that starts at now_us and samples for about sample_us, moved to finish
+// sof_sync_lead_us before a SOF (or an even split of the frame, for windows shorter than a frame) when sof_sync_enabled
+uint64_t sof_sync_window_end_time(uint64_t now_us, uint64_t sample_us);
+
+// called by core1 when a sampling window actually ended
+void sof_sync_record_window_end(uint64_t end_us);
@@ -0,0 +1,49 @@
+#pragma once
+#include "pico/stdlib.h"
+
+/**
+ * sequential probability ratio test on the raw samples of one sensor (FILTER_TYPE_SPRT).
+ *
+ * idle and pressed samples are modeled as gaussians with the same stddev (touch_sensor_noise, measured with the
+ * baseline) and means touch_sensor_baseline and touch_sensor_baseline + sprt_press_delta. every sample adds its log
+ * likelihood ratio to the evidence for the opposite of the current decision, which never drops below 0 (a CUSUM, i.e.
+ * an SPRT that restarts whenever it would accept the current decision). the decision flips as soon as the evidence
+ * crosses sprt_press_confidence * ln(10) (or sprt_release_confidence * ln(10)). the confidences are -log10 of the false
+ * trigger rate per sample, so that's the fastest detection for the rate. all in fixed point so it can run on every
+ * sample.
+ */
+
+#define SPRT_FRACTION_BITS 8
+// the largest per-count weight (delta / stddev^2), so a sample can't overflow 32 bits
+#define SPRT_MAX_SCALE (1 << 16)
+
+struct sprt_params_t {
+  // halfway between the idle and pressed means, in counts
+  int32_t midpoint;
+  // log likelihood ratio per count above the midpoint (delta / stddev^2), fixed point with SPRT_FRACTION_BITS
+  int32_t scale;
+  // evidence needed to flip the decision, sprt_press_confidence/sprt_release_confidence * ln(10) in fixed point
+  int32_t press_bound;
+  int32_t release_bound;
+  // a single sample (a spike) can't add more than this, see sprt_min_samples
+  int32_t max_step;
+};
+
+struct sprt_detector {
+  // evidence against the current decision, fixed point with SPRT_FRACTION_BITS
+  int32_t llr = 0;
+  bool pressed = false;
+
+  // returns true when the decision changed
+  inline bool add_value(int32_t v, const sprt_params_t& p) {
+    int32_t step = (v - p.midpoint) * p.scale;
+    step = MAX(-p.max_step, MIN(step, p.max_step));
+    llr = MAX(llr + (pressed ? -step : step), 0);
+    if (llr >= (pressed ? p.release_bound : p.press_bound)) {
+      pressed = !pressed;
+      llr = 0;
+      return true;
+    }
+    return false;
+  }
+};
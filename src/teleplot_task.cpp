@@ -3,6 +3,7 @@
 #include "config_defines.h"
 #include "custom_logging.hpp"
 #include "serial_config_console.hpp"
+#include "sof_sync.hpp"
 #include "touch_hid_tasks.hpp"
 #include "touch_sensor_config.hpp"
 #include "touch_sensor_thread.hpp"
@@ -58,16 +59,32 @@ void teleplot_task() {
     for (uint i = 0; i < num_touch_sensors; i++) {
       float val;
       if (teleplot_normalize_values) {
-        val = stats.by_sensor[i].get_mean_float() - touch_sensor_baseline[i];
+        val = stats.get_mean(i) - touch_sensor_baseline[i];
       } else {
-        val = stats.by_sensor[i].get_mean_float();
+        val = stats.get_mean(i);
       }
-      raw_sum = raw_sum + stats.by_sensor[i].get_mean_float();
+      raw_sum = raw_sum + stats.get_mean(i);
       base_sum = base_sum + touch_sensor_baseline[i];
       teleplot_printf(">t%d,s:%u:%.3f\r\n", i, timestamp, val);
     }
     teleplot_printf(">cur,sum:%ju:%f\r\n", timestamp, (double) raw_sum);
     teleplot_printf(">base,sum:%ju:%f\r\n", timestamp, (double) base_sum);
+    if (sof_sync_enabled) {
+      teleplot_printf(">sof:%ju:%d\r\n", timestamp, sof_sync_phase_error_us);
+    }
+    if (adaptive_window_enabled) {
+      teleplot_printf(">win:%ju:%u\r\n", timestamp, stats_extended.window_duration_us);
+    }
+    if (common_mode_rejection) {
+      teleplot_printf(">cm:%ju:%f\r\n", timestamp, (double) stats_extended.common_mode_value);
+    }
+    if (filter_type == FILTER_TYPE_KALMAN) {
+      // how far each baseline drifted since the calibration
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        teleplot_printf(">drift%d:%ju:%.2f\r\n", i, timestamp,
+                        (double) (stats_extended.tracked_baseline[i] - touch_sensor_baseline[i]));
+      }
+    }
 
     teleplot_flush();
   }
@@ -0,0 +1,397 @@
+#include <math.h>
+
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+
+#include "button_events.hpp"
+#include "config_values.hpp"
+#include "sensor_health.hpp"
+#include "touch_decision.hpp"
+#include "touch_sensor_thread.hpp"
+
+// for debounce
+static uint64_t sensor_press_timestamp[num_touch_sensors] = {0};
+static uint64_t sensor_release_timestamp[num_touch_sensors] = {0};
+static uint64_t game_button_press_timestamp[NUM_GAME_BUTTONS] = {0};
+static uint64_t game_button_release_timestamp[NUM_GAME_BUTTONS] = {0};
+
+bool sensor_currently_active[num_touch_sensors] = {false};
+static bool game_button_active[NUM_GAME_BUTTONS] = {false};
+static uint32_t prev_active_buttons = 0;
+// stats of the window currently being decided on
+static const running_stats* window_stats;
+// filtered value of each sensor (see running_stats::get_filtered_value) after crosstalk compensation
+float sensor_values[num_touch_sensors] = {0};
+
+// shared shift of all idle sensors that was removed by reject_common_mode()
+volatile float common_mode_value = 0;
+volatile value_t common_mode_offset = 0;
+
+button_event_log button_events;
+sprt_params_t sprt_params[num_touch_sensors];
+kalman_params_t kalman_params[num_touch_sensors];
+volatile bool touch_filter_params_dirty = true;
+// what sprt_params/kalman_params were last computed for
+static int params_filter_type = -1;
+
+void calibrate_from_chunks(const std::array<running_stats, num_touch_sensors> chunks[calibration_chunks]) {
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    running_stats all;
+    for (uint c = 0; c < calibration_chunks; c++) {
+      all.merge(chunks[c][i]);
+    }
+    touch_sensor_baseline[i] = all.get_mean_float();
+    touch_sensor_noise[i] = all.get_stddev();
+
+    // the means of consecutive chunks differ by the noise of both, plus however far the baseline walked in between
+    const float noise_var = touch_sensor_noise[i] * touch_sensor_noise[i];
+    float excess = 0;
+    float samples = 0;
+    for (uint c = 1; c < calibration_chunks; c++) {
+      count_t n0 = chunks[c - 1][i].get_total_count();
+      count_t n1 = chunks[c][i].get_total_count();
+      if (n0 == 0 || n1 == 0) {
+        continue;
+      }
+      float d = chunks[c][i].get_mean_float() - chunks[c - 1][i].get_mean_float();
+      excess += d * d - noise_var / n0 - noise_var / n1;
+      samples += (n0 + n1) * 0.5f;
+    }
+    touch_sensor_drift[i] = samples > 0 ? MAX(excess, 0.0f) / samples : 0;
+  }
+  touch_filter_params_dirty = true;
+}
+
+static void compute_sprt_params(sprt_params_t* params) {
+  const float ln10 = 2.302585f;
+  const int32_t press_bound = (int32_t)(MAX(sprt_press_confidence, 0.1f) * ln10 * (1 << SPRT_FRACTION_BITS));
+  const int32_t release_bound = (int32_t)(MAX(sprt_release_confidence, 0.1f) * ln10 * (1 << SPRT_FRACTION_BITS));
+  const int32_t max_step = MAX(MIN(press_bound, release_bound) / (int32_t)MAX(sprt_min_samples, 1), 1);
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    float delta = sprt_press_delta[i];
+    if (delta <= 0) {
+      delta = 2 * (touch_sensor_thresholds[i] - touch_sensor_baseline[i]);
+    }
+    delta = MAX(delta, 1.0f);
+    // counts are integers, so the noise is never really 0
+    float stddev = MAX(touch_sensor_noise[i], 0.5f);
+    float scale = delta / (stddev * stddev) * (1 << SPRT_FRACTION_BITS);
+
+    sprt_params_t& p = params[i];
+    p.midpoint = (int32_t)lroundf(touch_sensor_baseline[i] + delta / 2);
+    p.scale = (int32_t)MAX(MIN(scale, (float)SPRT_MAX_SCALE), 1.0f);
+    p.press_bound = press_bound;
+    p.release_bound = release_bound;
+    p.max_step = max_step;
+  }
+}
+
+// steady-state kalman gain of a random walk with per-sample variance q, measured with noise variance r
+static inline float steady_state_gain(float q, float r) {
+  float p = (q + sqrtf(q * q + 4 * q * r)) / 2;
+  return p / (p + r);
+}
+
+static void compute_kalman_params(kalman_params_t* params) {
+  const uint shift = MAX(MIN(kalman_signal_decay_shift, 30), 1);
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    // counts are integers, so the noise is never really 0
+    float r = MAX(touch_sensor_noise[i] * touch_sensor_noise[i], 0.25f);
+    float q_signal = MAX(kalman_signal_q, 0.0f) * r;
+    // to the baseline, the signal (stationary variance q / (1 - decay^2)) is just more noise
+    float signal_var = q_signal * (1 << shift) / 2;
+    float q_baseline = MAX(touch_sensor_drift[i], r * 1e-9f);
+
+    kalman_params_t& p = params[i];
+    p.signal_gain = (int32_t)(steady_state_gain(q_signal, r) * (1 << KALMAN_GAIN_FRACTION_BITS));
+    p.baseline_gain = (int32_t)(steady_state_gain(q_baseline, r + signal_var) * (1 << KALMAN_GAIN_FRACTION_BITS));
+    p.decay_shift = shift;
+  }
+}
+
+void update_touch_thresholds() {
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    switch (threshold_type) {
+      case THRESHOLD_TYPE_FACTOR:
+        touch_sensor_thresholds[i] = uint16_t(touch_sensor_baseline[i] * threshold_factor[i]);
+        break;
+      case THRESHOLD_TYPE_VALUE:
+        touch_sensor_thresholds[i] = uint16_t(touch_sensor_baseline[i] + threshold_value[i]);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // the filter params only change with the baseline and the config, and cost a few divisions and square roots each
+  if (!touch_filter_params_dirty && filter_type == params_filter_type) {
+    return;
+  }
+  // cleared first, so a change while computing isn't lost
+  touch_filter_params_dirty = false;
+  params_filter_type = filter_type;
+  // computed aside and swapped in at once, the FIFO interrupt reads them any time with TOUCH_POLLING_IRQ
+  if (filter_type == FILTER_TYPE_SPRT) {
+    sprt_params_t params[num_touch_sensors];
+    compute_sprt_params(params);
+    uint32_t save = save_and_disable_interrupts();
+    memcpy(sprt_params, params, sizeof(sprt_params));
+    restore_interrupts(save);
+  } else if (filter_type == FILTER_TYPE_KALMAN) {
+    kalman_params_t params[num_touch_sensors];
+    compute_kalman_params(params);
+    uint32_t save = save_and_disable_interrupts();
+    memcpy(kalman_params, params, sizeof(kalman_params));
+    restore_interrupts(save);
+  }
+}
+
+void reset_touch_decisions() {
+  memset(sensor_press_timestamp, 0, sizeof(sensor_press_timestamp));
+  memset(sensor_release_timestamp, 0, sizeof(sensor_release_timestamp));
+  memset(game_button_press_timestamp, 0, sizeof(game_button_press_timestamp));
+  memset(game_button_release_timestamp, 0, sizeof(game_button_release_timestamp));
+  memset(sensor_currently_active, 0, sizeof(sensor_currently_active));
+  memset(game_button_active, 0, sizeof(game_button_active));
+  memset(sensor_values, 0, sizeof(sensor_values));
+  common_mode_value = 0;
+  common_mode_offset = 0;
+  prev_active_buttons = 0;
+}
+
+// estimate the component shared by all sensors (mains hum, body coupling) as the median shift of the idle sensors,
+// and remove it from every sensor
+static void reject_common_mode() {
+  float idle_deltas[num_touch_sensors];
+  uint num_idle = 0;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    if (!sensor_currently_active[i] && sensor_is_healthy(i)) {
+      // insertion sort, there are only a few sensors
+      float delta = sensor_values[i] - touch_sensor_baseline[i];
+      uint j = num_idle++;
+      for (; j > 0 && idle_deltas[j - 1] > delta; j--) {
+        idle_deltas[j] = idle_deltas[j - 1];
+      }
+      idle_deltas[j] = delta;
+    }
+  }
+  // with fewer than 3 idle sensors the median can't reject a sensor that is just starting to be pressed
+  if (num_idle < 3) {
+    common_mode_value = 0;
+    return;
+  }
+  if (num_idle % 2) {
+    common_mode_value = idle_deltas[num_idle / 2];
+  } else {
+    common_mode_value = 0.5f * (idle_deltas[num_idle / 2 - 1] + idle_deltas[num_idle / 2]);
+  }
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    sensor_values[i] -= common_mode_value;
+  }
+}
+
+// subtract the share of every other sensor's signal that leaks into each sensor, using the crosstalk matrix
+static void compensate_crosstalk() {
+  int32_t delta[num_touch_sensors];
+  for (uint j = 0; j < num_touch_sensors; j++) {
+    // only presses leak into neighbors, so don't spread idle noise around (or garbage from a broken sensor)
+    delta[j] = sensor_is_healthy(j) ? MAX((int32_t)sensor_values[j] - (int32_t)touch_sensor_baseline[j], 0) : 0;
+  }
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    const int* row = &crosstalk[i * num_touch_sensors];
+    int32_t correction = 0;
+    for (uint j = 0; j < num_touch_sensors; j++) {
+      correction += row[j] * delta[j];
+    }
+    sensor_values[i] -= (correction + (1 << (CROSSTALK_FRACTION_BITS - 1))) >> CROSSTALK_FRACTION_BITS;
+  }
+}
+
+static inline bool sensor_is_above_threshold(uint i, bool currently_active) {
+  if (filter_type == FILTER_TYPE_SPRT) {
+    // already decided sample by sample, with its own hysteresis
+    return window_stats[i].sprt.pressed;
+  }
+  if (filter_type == FILTER_TYPE_MEDIAN) {
+    // the median filter only counts samples above the threshold, common mode is compensated in that threshold (see
+    // sampling_threshold)
+    return window_stats[i].median_is_above_threshold_hysteresis(currently_active, hysteresis[i]);
+  }
+  float threshold = window_stats[i].threshold - (currently_active ? hysteresis[i] : 0);
+  return sensor_values[i] >= threshold;
+}
+
+// returns the new state, ignoring changes that happen within debounce_us of the last one
+static inline bool debounce(bool active,
+                            bool currently_active,
+                            uint64_t now_us,
+                            uint64_t debounce_us,
+                            uint64_t& press_timestamp,
+                            uint64_t& release_timestamp) {
+  if (!debounce_us) {
+    return active;
+  }
+  if (now_us - press_timestamp < debounce_us) {
+    // inside press debounce window
+    // ignore that release
+    return currently_active;
+  } else if (now_us - release_timestamp < debounce_us) {
+    // inside release debounce window
+    // ignore that press
+    return currently_active;
+  } else if (currently_active && !active) {
+    // was pressed, now released
+    release_timestamp = now_us;
+  } else if (!currently_active && active) {
+    // was released, now pressed
+    press_timestamp = now_us;
+  }
+  return active;
+}
+
+// signal of one sensor scaled so that 0 is the baseline and 1 is the (hysteresis adjusted) threshold
+static inline float normalized_sensor_value(uint i, bool currently_active) {
+  if (filter_type == FILTER_TYPE_SPRT) {
+    return window_stats[i].sprt.pressed ? 1 : 0;
+  }
+  float threshold = window_stats[i].threshold - (currently_active ? hysteresis[i] : 0);
+  float value = sensor_values[i];
+  float range = threshold - touch_sensor_baseline[i];
+  if (range <= 0) {
+    return value >= threshold ? 1 : 0;
+  }
+  return (value - touch_sensor_baseline[i]) / range;
+}
+
+// combine all sensors mapped to each game button into one decision per button
+static void __time_critical_func(fuse_sensors_by_button)(uint64_t now_us) {
+  uint sensor_count[NUM_GAME_BUTTONS] = {0};
+  float value_sum[NUM_GAME_BUTTONS] = {0};
+  float value_max[NUM_GAME_BUTTONS] = {0};
+  float weighted_sum[NUM_GAME_BUTTONS] = {0};
+  float weight_total[NUM_GAME_BUTTONS] = {0};
+
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    if (!sensor_is_healthy(i)) {
+      continue;
+    }
+    game_button btn = touch_sensor_configs[i].button;
+    // hysteresis follows the button state, since that is what the sensors are voting on
+    float v = normalized_sensor_value(i, game_button_active[btn]);
+    value_max[btn] = sensor_count[btn] == 0 ? v : MAX(value_max[btn], v);
+    sensor_count[btn]++;
+    value_sum[btn] += v;
+    weighted_sum[btn] += fusion_weight[i] * v;
+    weight_total[btn] += fusion_weight[i];
+  }
+
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    sensor_currently_active[i] = sensor_is_healthy(i) && normalized_sensor_value(i, sensor_currently_active[i]) >= 1;
+  }
+
+  for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
+    if (sensor_count[gbtn] == 0) {
+      continue;
+    }
+    bool active;
+    switch (fusion_type) {
+      case FUSION_TYPE_SUM:
+        active = value_sum[gbtn] >= sensor_count[gbtn];
+        break;
+      case FUSION_TYPE_MAX:
+        active = value_max[gbtn] >= 1;
+        break;
+      case FUSION_TYPE_VOTE:
+        active = weight_total[gbtn] > 0 && weighted_sum[gbtn] >= weight_total[gbtn];
+        break;
+      default:
+        active = false;
+        break;
+    }
+
+    // use the slowest debounce of all sensors on this button
+    uint64_t button_debounce_us = 0;
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      if (touch_sensor_configs[i].button == gbtn) {
+        button_debounce_us = MAX(button_debounce_us, debounce_us[i]);
+      }
+    }
+    game_button_active[gbtn] =
+        debounce(active, game_button_active[gbtn], now_us, button_debounce_us, game_button_press_timestamp[gbtn],
+                 game_button_release_timestamp[gbtn]);
+  }
+}
+
+// log the buttons that changed, with the button's sensor that is furthest above (or least below) its threshold
+static void __time_critical_func(log_button_events)(uint32_t changed_buttons, uint32_t active_buttons,
+                                                    uint64_t timestamp_us) {
+  for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
+    if (!(changed_buttons & (1u << gbtn))) {
+      continue;
+    }
+    button_event_t e = {timestamp_us, 0, 0, (uint8_t)gbtn, 0, (bool)(active_buttons & (1u << gbtn))};
+    bool found = false;
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      float margin = sensor_values[i] - touch_sensor_thresholds[i];
+      if (touch_sensor_configs[i].button == gbtn && (!found || margin > e.margin)) {
+        e.filtered_value = sensor_values[i];
+        e.margin = margin;
+        e.sensor = i;
+        found = true;
+      }
+    }
+    button_events.push(e);
+  }
+}
+
+uint32_t __time_critical_func(update_touch_decisions)(const std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                       uint64_t timestamp_us) {
+  window_stats = by_sensor.data();
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    if (filter_type == FILTER_TYPE_KALMAN) {
+      // drift removed, but on the same scale as the thresholds
+      sensor_values[i] = touch_sensor_baseline[i] + window_stats[i].kalman.get_signal();
+    } else {
+      sensor_values[i] = window_stats[i].get_filtered_value(filter_type);
+    }
+  }
+  if (common_mode_rejection) {
+    reject_common_mode();
+  } else {
+    common_mode_value = 0;
+  }
+  common_mode_offset = (value_t)lroundf(common_mode_value);
+  compensate_crosstalk();
+
+  // debounce uses the time of the sample the decision was made on, so it doesn't depend on when core0 gets to it
+  const uint64_t now_us = timestamp_us;
+  if (fusion_type != FUSION_TYPE_ANY) {
+    fuse_sensors_by_button(now_us);
+  } else {
+    memset(game_button_active, 0, sizeof(game_button_active));
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      bool active = sensor_is_healthy(i) && sensor_is_above_threshold(i, sensor_currently_active[i]);
+
+      // debounce each sensor separately, since they can have different noise levels
+      active = debounce(active, sensor_currently_active[i], now_us, debounce_us[i], sensor_press_timestamp[i],
+                        sensor_release_timestamp[i]);
+
+      sensor_currently_active[i] = active;
+      if (active) {
+        game_button_active[touch_sensor_configs[i].button] = true;
+      }
+    }
+  }
+
+  uint32_t active_buttons = 0;
+  for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
+    if (game_button_active[gbtn]) {
+      active_buttons |= 1u << gbtn;
+    }
+  }
+  if (active_buttons != prev_active_buttons) {
+    log_button_events(active_buttons ^ prev_active_buttons, active_buttons, timestamp_us);
+    prev_active_buttons = active_buttons;
+  }
+  return active_buttons;
+}
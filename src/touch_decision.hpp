@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+
+#include "kalman.hpp"
+#include "running_stats.hpp"
+#include "sprt.hpp"
+#include "touch_sensor_config.hpp"
+#include "touch_sensor_thread.hpp"
+
+// these are written by core1
+extern bool sensor_currently_active[num_touch_sensors];
+// filtered value of each sensor, after common mode rejection and crosstalk compensation
+extern float sensor_values[num_touch_sensors];
+extern volatile float common_mode_value;
+// common_mode_value rounded to counts while common_mode_rejection is on, else 0. the raw samples of the next window are
+// compared against it (see sampling_threshold), so the filters that never look at sensor_values are compensated too
+extern volatile value_t common_mode_offset;
+
+// per sensor, computed by update_touch_thresholds() while filter_type is FILTER_TYPE_SPRT/FILTER_TYPE_KALMAN
+extern sprt_params_t sprt_params[num_touch_sensors];
+extern kalman_params_t kalman_params[num_touch_sensors];
+// set when the baseline or a config value changes, so update_touch_thresholds() recomputes the filter params
+extern volatile bool touch_filter_params_dirty;
+
+// the number of parts the baseline calibration is split into, to measure the drift between them
+constexpr uint calibration_chunks = 8;
+
+// set touch_sensor_baseline, touch_sensor_noise and touch_sensor_drift from consecutive parts of an untouched recording
+void calibrate_from_chunks(const std::array<running_stats, num_touch_sensors> chunks[calibration_chunks]);
+
+// set touch_sensor_thresholds (and the filter params) from the baseline and the configured sensitivity
+void update_touch_thresholds();
+
+// feed one raw sample of sensor i to the filters that run per sample instead of per window (filter is the
+// filter_type for this window). returns true when the sensor's decision changed, so the window can end early
+static inline bool sample_filters_add_value(running_stats& stats, uint i, value_t value, int filter) {
+  switch (filter) {
+    case FILTER_TYPE_SPRT:
+      return stats.sprt.add_value(value - common_mode_offset, sprt_params[i]);
+    case FILTER_TYPE_KALMAN:
+      stats.kalman.add_value(value, kalman_params[i], sensor_currently_active[i]);
+      return false;
+    default:
+      return false;
+  }
+}
+
+// forget all sensor and button states (everything released)
+void reset_touch_decisions();
+
+// what the raw samples of sensor i are counted against in the next window (FILTER_TYPE_MEDIAN)
+static inline value_t sampling_threshold(uint i) {
+  return touch_sensor_thresholds[i] + common_mode_offset;
+}
+
+// thresholding, hysteresis, fusion and debounce of one window, on core1. timestamp_us is the time of the last sample in
+// the window. returns the active game buttons as a bitmask of (1 << game_button)
+uint32_t update_touch_decisions(const std::array<running_stats, num_touch_sensors>& by_sensor, uint64_t timestamp_us);
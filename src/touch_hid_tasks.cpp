@@ -5,7 +5,10 @@
 #include "tusb.h"
 #include "usb_descriptors.h"
 
+#include "autotune.hpp"
+#include "custom_logging.hpp"
 #include "touch_hid_tasks.hpp"
+#include "vendor_protocol.hpp"
 
 // TODO: some way to make these dependent on which player it is
 uint8_t game_button_to_keycode_map[NUM_GAME_BUTTONS] = {
@@ -50,15 +53,21 @@ uint8_t hid_report_keycodes[6] = {0};
 bool hid_report_dirty = true;
 bool active_game_buttons_map[NUM_GAME_BUTTONS] = {false};
 touchpad_stats_t stats;
+touchpad_stats_extended_t stats_extended;
 
-// for debounce
-static uint64_t game_button_press_timestamp[NUM_GAME_BUTTONS] = {0};
-static uint64_t game_button_release_timestamp[NUM_GAME_BUTTONS] = {0};
-
-// TODO reorganize
-bool sensor_currently_active[num_touch_sensors] = {false};
+// time of the sample that caused the most recent press/release of each button
+uint64_t game_button_event_timestamp[NUM_GAME_BUTTONS] = {0};
+uint32_t touchpad_stats_frame_count = 0;
 
 void touch_stats_handler_task() {
+  // core1 only fills in the extended frames while someone is looking at them
+#if SERIAL_TELEPLOT
+  touchpad_stats_extended_enabled = teleplot_is_connected() || vendor_protocol_streaming();
+#else
+  touchpad_stats_extended_enabled = vendor_protocol_streaming();
+#endif
+  queue_try_remove(&q_touchpad_stats_extended, &stats_extended);
+
   if (queue_is_empty(&q_touchpad_stats)) {
     return;
   }
@@ -67,63 +76,21 @@ void touch_stats_handler_task() {
   while (!queue_is_empty(&q_touchpad_stats)) {
     queue_try_remove(&q_touchpad_stats, &stats);
   }
+  touchpad_stats_frame_count++;
+  autotune_add_frame(stats);
 
-  bool prev_active_game_buttons_map[NUM_GAME_BUTTONS] = {0};
-  memcpy(prev_active_game_buttons_map, active_game_buttons_map, sizeof(active_game_buttons_map));
-
-  memset(active_game_buttons_map, 0, sizeof(active_game_buttons_map));
-  for (uint i = 0; i < num_touch_sensors; i++) {
-    switch (filter_type) {
-      case FILTER_TYPE_MEDIAN:
-        if (stats.by_sensor[i].median_is_above_threshold_hysteresis(sensor_currently_active[i], hysteresis)) {
-          active_game_buttons_map[touch_sensor_configs[i].button] = true;
-          sensor_currently_active[i] = true;
-        } else {
-          sensor_currently_active[i] = false;
-        }
-        break;
-      case FILTER_TYPE_AVG:
-        if (stats.by_sensor[i].avg_is_above_threshold_hysteresis(sensor_currently_active[i], hysteresis)) {
-          active_game_buttons_map[touch_sensor_configs[i].button] = true;
-          sensor_currently_active[i] = true;
-        } else {
-          sensor_currently_active[i] = false;
-        }
-        break;
-      case FILTER_TYPE_IIR:
-        if (stats.by_sensor[i].iir_is_above_threshold_hysteresis(sensor_currently_active[i], hysteresis)) {
-          active_game_buttons_map[touch_sensor_configs[i].button] = true;
-          sensor_currently_active[i] = true;
-        } else {
-          sensor_currently_active[i] = false;
-        }
-        break;
-
-      default:
-        // TODO invalid value
-        break;
+  // thresholding, fusion and debounce already happened on core1
+  uint32_t changed_buttons = 0;
+  for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
+    bool active = stats.active_buttons & (1u << gbtn);
+    if (active != active_game_buttons_map[gbtn]) {
+      game_button_event_timestamp[gbtn] = stats.timestamp_us;
+      changed_buttons |= 1u << gbtn;
     }
+    active_game_buttons_map[gbtn] = active;
   }
-
-  if (debounce_us) {
-    uint64_t now_us = time_us_64();
-    for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
-      if (now_us - game_button_press_timestamp[gbtn] < debounce_us) {
-        // inside press debounce window
-        // ignore that release
-        active_game_buttons_map[gbtn] = true;
-      } else if (now_us - game_button_release_timestamp[gbtn] < debounce_us) {
-        // inside release debounce window
-        // ignore that press
-        active_game_buttons_map[gbtn] = false;
-      } else if (prev_active_game_buttons_map[gbtn] && !active_game_buttons_map[gbtn]) {
-        // was pressed, now released
-        game_button_release_timestamp[gbtn] = now_us;
-      } else if (!prev_active_game_buttons_map[gbtn] && active_game_buttons_map[gbtn]) {
-        // was released, now pressed
-        game_button_press_timestamp[gbtn] = now_us;
-      }
-    }
+  if (!changed_buttons) {
+    return;
   }
 
   memset(hid_report_keycodes, 0, sizeof(hid_report_keycodes));
@@ -146,7 +113,17 @@ void hid_task(void) {
   if (tud_suspended()) {
     // Wake up host if we are in suspend mode
     // and REMOTE_WAKEUP feature is enabled by host
-    tud_remote_wakeup();
+    // only for a press that has been held for a while, so a bump or noise doesn't wake up the computer
+    static uint64_t last_wakeup_us = 0;
+    for (int gbtn = 0; gbtn < NUM_GAME_BUTTONS; gbtn++) {
+      if (active_game_buttons_map[gbtn] &&
+          stats.timestamp_us - game_button_event_timestamp[gbtn] >= remote_wakeup_hold_us &&
+          game_button_event_timestamp[gbtn] > last_wakeup_us) {
+        tud_remote_wakeup();
+        last_wakeup_us = stats.timestamp_us;
+        break;
+      }
+    }
   }
 
   if (!hid_report_dirty) {
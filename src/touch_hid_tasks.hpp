@@ -11,6 +11,12 @@ extern uint8_t hid_report_keycodes[6];
 extern bool hid_report_dirty;
 extern bool active_game_buttons_map[NUM_GAME_BUTTONS];
 extern touchpad_stats_t stats;
+// the latest extended frame, only updated while touchpad_stats_extended_enabled
+extern touchpad_stats_extended_t stats_extended;
+// time of the sample that caused the most recent press/release of each button
+extern uint64_t game_button_event_timestamp[NUM_GAME_BUTTONS];
+// incremented for every frame received from core1
+extern uint32_t touchpad_stats_frame_count;
 
 
 void touch_stats_handler_task();
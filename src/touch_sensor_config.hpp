@@ -54,6 +54,8 @@ struct touch_sensor_config_t {
 // values for TOUCH_POLLING_TYPE
 #define TOUCH_POLLING_PARALLEL 1
 #define TOUCH_POLLING_SEQUENTIAL 2
+// every sensor has its own state machine (like parallel), running free and read from FIFO interrupts
+#define TOUCH_POLLING_IRQ 3
 
 // values for TOUCH_LAYOUT_TYPE
 #define TOUCH_LAYOUT_ITG 1
@@ -1,14 +1,24 @@
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "hardware/irq.h"
 #include "hardware/pio.h"
+#include "hardware/sync.h"
 #include "hardware/timer.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
 
+#include "bench.hpp"
 #include "config_defines.h"
 #include "multicore_ipc.h"
 #include "running_stats.hpp"
 #include "serial_config_console.hpp"
+#include "sensor_counters.hpp"
+#include "sensor_health.hpp"
+#include "sliding_window.hpp"
+#include "sof_sync.hpp"
+#include "touch_decision.hpp"
 #include "touch.pio.h"
 #include "touch_sensor_config.hpp"
 #include "touch_sensor_thread.hpp"
@@ -19,14 +29,28 @@
 // uint16_t touch_sensor_thresholds[num_touch_sensors] = {200, 200, 200, 200, 200, 200, 200, 200};
 uint16_t touch_sensor_thresholds[num_touch_sensors] = {200};
 float touch_sensor_baseline[num_touch_sensors] = {0};
+float touch_sensor_noise[num_touch_sensors] = {0};
+float touch_sensor_drift[num_touch_sensors] = {0};
 
 volatile uint32_t touch_sample_count = 0;
+volatile bool touch_recalibration_requested = false;
+volatile bool touchpad_stats_extended_enabled = false;
+volatile uint32_t window_duration_us = 0;
 
 #pragma endregion sensor config
 
+// the charge loop timed out (broken wire) or the pin never discharged (shorted)
+static inline bool is_saturated(value_t value) {
+  return value <= 0 || value >= TOUCH_TIMEOUT;
+}
+
 #if TOUCH_POLLING_TYPE == TOUCH_POLLING_PARALLEL
 static PIO pios[NUM_PIOS] = {pio0, pio1};
 
+// copied from touch_sensors_by_pio at startup, so the sampling loop only reads core1's own memory
+static uint8_t __core1_data("touch") sm_by_pio[NUM_PIOS][num_touch_sensors / 2];
+static uint8_t __core1_data("touch") sensor_by_pio[NUM_PIOS][num_touch_sensors / 2];
+
 void init_touch_sensors() {
   uint pio0_offset = pio_add_program(pio0, &touch_program);
   IF_SERIAL_LOG(printf("Loaded program in pio0 at %d\n", pio0_offset));
@@ -49,34 +73,53 @@ void init_touch_sensors() {
     pio_set_irq0_source_enabled(pio, (enum pio_interrupt_source)((uint)pis_interrupt0 + cfg.sm), false);
     pio_set_irq1_source_enabled(pio, (enum pio_interrupt_source)((uint)pis_interrupt0 + cfg.sm), false);
   }
+
+  for (uint pio_idx = 0; pio_idx < NUM_PIOS; pio_idx++) {
+    for (uint j = 0; j < num_touch_sensors / 2; j++) {
+      const touch_sensor_config_t& cfg = touch_sensors_by_pio[pio_idx][j];
+      sm_by_pio[pio_idx][j] = cfg.sm;
+      for (uint i = 0; i < num_touch_sensors; i++) {
+        if (touch_sensor_configs[i].pio_idx == pio_idx && touch_sensor_configs[i].sm == cfg.sm) {
+          sensor_by_pio[pio_idx][j] = i;
+        }
+      }
+    }
+  }
 }
 
-touchpad_stats_t __time_critical_func(sample_touch_inputs_for_us)(uint64_t duration_us, bool init = false) {
-  uint64_t end_time = time_us_64() + duration_us - sampling_buffer_time_us;
+// samples for about sample_us (the caller leaves out sampling_buffer_time_us), fills by_sensor in place, returns the
+// time of the last sample
+uint64_t __core1_func(sample_touch_inputs_for_us)(std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                  uint64_t sample_us, bool init = false) {
+  uint64_t end_time = init ? time_us_64() + sample_us : sof_sync_window_end_time(time_us_64(), sample_us);
 
-  // just allocate all of them and assume that's ok
-  running_stats stats_by_pio_sm[NUM_PIOS][NUM_PIO_STATE_MACHINES];
   // set the proper threshold values
   for (uint i = 0; i < num_touch_sensors; i++) {
-    touch_sensor_config_t cfg = touch_sensor_configs[i];
-    stats_by_pio_sm[cfg.pio_idx][cfg.sm].threshold = touch_sensor_thresholds[i];
+    by_sensor[i].start_window(sampling_threshold(i));
   }
 
-  while (time_us_64() < end_time) {
+  // the per-sample filters don't run during calibration. with FILTER_TYPE_SPRT, end the window as soon as a sensor
+  // changes its decision
+  const int sample_filter = init ? -1 : filter_type;
+  bool decision_changed = false;
+  while (time_us_64() < end_time && !decision_changed) {
     for (uint pio_idx = 0; pio_idx < NUM_PIOS; pio_idx++) {
       const PIO pio = pios[pio_idx];
 
       pio_interrupt_clear(pio, 1);
       // for (uint sm = 0; sm < 4; sm++)
-      for (uint i = 0; i < num_touch_sensors / 2; i++) {
-        touch_sensor_config_t cfg = touch_sensors_by_pio[pio_idx][i];
-        int16_t value = TOUCH_TIMEOUT - pio_sm_get_blocking(pio, cfg.sm);
+      for (uint j = 0; j < num_touch_sensors / 2; j++) {
+        int16_t value = TOUCH_TIMEOUT - pio_sm_get_blocking(pio, sm_by_pio[pio_idx][j]);
+        const uint8_t i = sensor_by_pio[pio_idx][j];
+        running_stats& stats = by_sensor[i];
 #if TOUCH_SINGLE_SAMPLE_DEBUG
-        if (stats_by_pio_sm[cfg.pio_idx][cfg.sm].get_total_count() == 0) {
-          stats_by_pio_sm[cfg.pio_idx][cfg.sm].add_value(value);
+        if (stats.get_total_count() == 0) {
+          stats.add_value(value);
         }
 #else
-        stats_by_pio_sm[cfg.pio_idx][cfg.sm].add_value(value);
+        stats.add_value(value);
+        stats.saturated_count += is_saturated(value);
+        decision_changed |= sample_filters_add_value(stats, i, value, sample_filter);
 #endif
       }
       pio_interrupt_clear(pio, 0);
@@ -85,20 +128,28 @@ touchpad_stats_t __time_critical_func(sample_touch_inputs_for_us)(uint64_t durat
       touch_sample_count++;
     }
   }
-  std::array<running_stats, num_touch_sensors> by_sensor;
-  for (uint i = 0; i < num_touch_sensors; i++) {
-    touch_sensor_config_t cfg = touch_sensor_configs[i];
-    by_sensor[i] = stats_by_pio_sm[cfg.pio_idx][cfg.sm];
+  uint64_t last_sample_us = time_us_64();
+  // an early end says nothing about the SOF alignment
+  if (!init && !decision_changed) {
+    sof_sync_record_window_end(last_sample_us);
   }
-  return {by_sensor};
+  return last_sample_us;
 }
 
+// the state machines sync after every measurement (see touch), so there is nothing to accumulate
+static void apply_touch_accum_shift() {}
+
 #elif TOUCH_POLLING_TYPE == TOUCH_POLLING_SEQUENTIAL
 
 static uint pio0_offset;
+// copied from touch_sensor_configs at startup, so the sampling loop only reads core1's own memory
+static uint8_t __core1_data("touch") sensor_pins[num_touch_sensors];
+// what the state machine is programmed for, see apply_touch_accum_shift
+static uint __core1_data("touch") accum_shift = 0;
+
 void init_touch_sensors() {
   // for sequential polling, we just need one PIO
-  pio0_offset = pio_add_program(pio0, &touch_program);
+  pio0_offset = pio_add_program(pio0, &touch_accum_program);
   IF_SERIAL_LOG(printf("Loaded program in pio0 at %d\n", pio0_offset));
 
   for (uint i = 0; i < num_touch_sensors; i++) {
@@ -111,34 +162,45 @@ void init_touch_sensors() {
     gpio_set_drive_strength(cfg.pin, GPIO_DRIVE_STRENGTH_12MA);
 
     pio_sm_set_enabled(pio0, 0, false);
-    touch_program_init(pio0, 0, pio0_offset, cfg.pin);
+    touch_accum_program_init(pio0, 0, pio0_offset, cfg.pin, accum_shift);
     pio_sm_set_enabled(pio0, 0, true);
     pio_set_irq0_source_enabled(pio0, (enum pio_interrupt_source)((uint)pis_interrupt0), false);
     pio_set_irq1_source_enabled(pio0, (enum pio_interrupt_source)((uint)pis_interrupt0), false);
+    sensor_pins[i] = cfg.pin;
   }
 }
-touchpad_stats_t __time_critical_func(sample_touch_inputs_for_us)(uint64_t duration_us, bool init = false) {
-  uint64_t end_time = time_us_64() + duration_us - sampling_buffer_time_us;
 
-  running_stats stats_by_sensor[num_touch_sensors];
+// between windows only, the sampling loop restarts the state machine for every sensor anyway
+static void apply_touch_accum_shift() {
+  pio_sm_set_enabled(pio0, 0, false);
+  accum_shift = MIN(touch_accum_shift, TOUCH_ACCUM_MAX_SHIFT);
+  touch_accum_set_shift(pio0, pio0_offset, accum_shift);
+}
+// samples for about sample_us (the caller leaves out sampling_buffer_time_us), fills by_sensor in place, returns the
+// time of the last sample
+uint64_t __core1_func(sample_touch_inputs_for_us)(std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                  uint64_t sample_us, bool init = false) {
+  uint64_t end_time = init ? time_us_64() + sample_us : sof_sync_window_end_time(time_us_64(), sample_us);
+
   // set the proper threshold values
   for (uint i = 0; i < num_touch_sensors; i++) {
-    stats_by_sensor[i].threshold = touch_sensor_thresholds[i];
+    by_sensor[i].start_window(sampling_threshold(i));
   }
 
-  while (time_us_64() < end_time) {
+  // the per-sample filters don't run during calibration. with FILTER_TYPE_SPRT, end the window as soon as a sensor
+  // changes its decision
+  const int sample_filter = init ? -1 : filter_type;
+  bool decision_changed = false;
+  while (time_us_64() < end_time && !decision_changed) {
     for (uint i = 0; i < num_touch_sensors; i++) {
-      touch_sensor_config_t cfg = touch_sensor_configs[i];
-
-      pio_interrupt_clear(pio0, 1);
       pio_sm_set_enabled(pio0, 0, false);
-      touch_program_init(pio0, 0, pio0_offset, cfg.pin);
+      touch_accum_program_init(pio0, 0, pio0_offset, sensor_pins[i], accum_shift);
       pio_sm_set_enabled(pio0, 0, true);
 
-      int16_t value = TOUCH_TIMEOUT - pio_sm_get_blocking(pio0, 0);
-      stats_by_sensor[i].add_value(value);
-      pio_interrupt_clear(pio0, 0);
-      // pio_interrupt_clear(pio0, 1);
+      int16_t value = touch_accum_mean(pio_sm_get_blocking(pio0, 0), accum_shift);
+      by_sensor[i].add_value(value);
+      by_sensor[i].saturated_count += is_saturated(value);
+      decision_changed |= sample_filters_add_value(by_sensor[i], i, value, sample_filter);
       if (sleep_us_between_samples) {
         sleep_us(sleep_us_between_samples);
       }
@@ -147,15 +209,255 @@ touchpad_stats_t __time_critical_func(sample_touch_inputs_for_us)(uint64_t durat
       touch_sample_count++;
     }
   }
-  std::array<running_stats, num_touch_sensors> by_sensor;
+  uint64_t last_sample_us = time_us_64();
+  // an early end says nothing about the SOF alignment
+  if (!init && !decision_changed) {
+    sof_sync_record_window_end(last_sample_us);
+  }
+  return last_sample_us;
+}
+
+#elif TOUCH_POLLING_TYPE == TOUCH_POLLING_IRQ
+
+static PIO pios[NUM_PIOS] = {pio0, pio1};
+static_assert(num_touch_sensors <= NUM_PIOS * NUM_PIO_STATE_MACHINES, "IRQ polling needs one state machine per sensor");
+
+constexpr uint8_t no_sensor = 0xff;
+static uint8_t __core1_data("touch") sensor_by_pio_sm[NUM_PIOS][NUM_PIO_STATE_MACHINES];
+static uint pio_offsets[NUM_PIOS];
+// what the state machines are programmed for, see apply_touch_accum_shift
+static uint __core1_data("touch") accum_shift = 0;
+
+// filled by the FIFO interrupts, swapped out at the end of every window
+static running_stats __core1_data("touch") irq_stats[num_touch_sensors];
+static uint64_t last_window_end_us = 0;
+// filter_type for the per-sample filters, -1 during calibration
+static volatile int irq_sample_filter = -1;
+// a sensor changed its FILTER_TYPE_SPRT decision, so the window can end early
+static volatile bool irq_decision_changed = false;
+
+// one pass over the results that were there on entry. draining until every FIFO is empty would never end once the
+// state machines are throttled to the handler's pace, and the sampling loop would never get to run
+static inline void __core1_func(touch_pio_irq_handler)(uint pio_idx) {
+  const PIO pio = pios[pio_idx];
+  const uint32_t levels = pio->flevel;
+  for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+    uint n = (levels >> (PIO_FLEVEL_RX0_LSB + sm * (PIO_FLEVEL_RX1_LSB - PIO_FLEVEL_RX0_LSB))) & 0xf;
+    uint8_t i = sensor_by_pio_sm[pio_idx][sm];
+    for (; n > 0; n--) {
+      value_t value = touch_accum_mean(pio->rxf[sm], accum_shift);
+      if (i != no_sensor) {
+        irq_stats[i].add_value(value);
+        irq_stats[i].saturated_count += is_saturated(value);
+        if (sample_filters_add_value(irq_stats[i], i, value, irq_sample_filter)) {
+          irq_decision_changed = true;
+        }
+      }
+    }
+  }
+}
+static void __core1_func(touch_pio0_irq_handler)() {
+  touch_pio_irq_handler(0);
+}
+static void __core1_func(touch_pio1_irq_handler)() {
+  touch_pio_irq_handler(1);
+}
+
+static void set_touch_irqs_enabled(bool enabled) {
+  irq_set_enabled(PIO0_IRQ_0, enabled);
+  irq_set_enabled(PIO1_IRQ_0, enabled);
+}
+
+// move the accumulated samples out, and start over with the current thresholds. the filter states live here, during
+// calibration they start over
+static inline void __core1_func(take_irq_stats)(std::array<running_stats, num_touch_sensors>& by_sensor, bool init) {
+  uint32_t save = save_and_disable_interrupts();
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    by_sensor[i] = irq_stats[i];
+    if (init) {
+      irq_stats[i].reset();
+    }
+    irq_stats[i].start_window(sampling_threshold(i));
+  }
+  irq_decision_changed = false;
+  restore_interrupts(save);
+}
+
+static void start_state_machines() {
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    touch_sensor_config_t cfg = touch_sensor_configs[i];
+    touch_accum_program_init(pios[cfg.pio_idx], cfg.sm, pio_offsets[cfg.pio_idx], cfg.pin, accum_shift);
+    pio_sm_set_enabled(pios[cfg.pio_idx], cfg.sm, true);
+  }
+}
+
+// must run on core1, so the interrupts are handled there
+void init_touch_sensors() {
+  // start with the configured shift, at 1 measurement per sample the interrupts can take most of core1
+  accum_shift = MIN(touch_accum_shift, TOUCH_ACCUM_MAX_SHIFT);
+  pio_offsets[0] = pio_add_program(pio0, &touch_accum_program);
+  IF_SERIAL_LOG(printf("Loaded program in pio0 at %d\n", pio_offsets[0]));
+  pio_offsets[1] = pio_add_program(pio1, &touch_accum_program);
+  IF_SERIAL_LOG(printf("Loaded program in pio1 at %d\n", pio_offsets[1]));
+
+  for (uint pio_idx = 0; pio_idx < NUM_PIOS; pio_idx++) {
+    touch_accum_set_shift(pios[pio_idx], pio_offsets[pio_idx], accum_shift);
+  }
+  memset(sensor_by_pio_sm, no_sensor, sizeof(sensor_by_pio_sm));
+
   for (uint i = 0; i < num_touch_sensors; i++) {
-    by_sensor[i] = stats_by_sensor[i];
+    touch_sensor_config_t cfg = touch_sensor_configs[i];
+    const PIO pio = pios[cfg.pio_idx];
+    sensor_by_pio_sm[cfg.pio_idx][cfg.sm] = i;
+
+    gpio_disable_pulls(cfg.pin);
+    gpio_set_drive_strength(cfg.pin, GPIO_DRIVE_STRENGTH_12MA);
+    pio_set_irq0_source_enabled(pio, (enum pio_interrupt_source)((uint)pis_sm0_rx_fifo_not_empty + cfg.sm), true);
+  }
+  start_state_machines();
+
+  irq_set_exclusive_handler(PIO0_IRQ_0, touch_pio0_irq_handler);
+  irq_set_exclusive_handler(PIO1_IRQ_0, touch_pio1_irq_handler);
+  set_touch_irqs_enabled(true);
+}
+
+// between windows only. restarting the state machines drops the results measured with the old shift
+static void apply_touch_accum_shift() {
+  uint shift = MIN(touch_accum_shift, TOUCH_ACCUM_MAX_SHIFT);
+  if (shift == accum_shift) {
+    return;
+  }
+  set_touch_irqs_enabled(false);
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    pio_sm_set_enabled(pios[touch_sensor_configs[i].pio_idx], touch_sensor_configs[i].sm, false);
+  }
+  accum_shift = shift;
+  for (uint pio_idx = 0; pio_idx < NUM_PIOS; pio_idx++) {
+    touch_accum_set_shift(pios[pio_idx], pio_offsets[pio_idx], accum_shift);
   }
-  return {by_sensor};
+  start_state_machines();
+  set_touch_irqs_enabled(true);
+}
+
+// samples for about sample_us (the caller leaves out sampling_buffer_time_us), fills by_sensor in place, returns the
+// time of the last sample
+uint64_t __core1_func(sample_touch_inputs_for_us)(std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                  uint64_t sample_us, bool init = false) {
+  uint64_t now = time_us_64();
+  uint64_t end_time = init ? now + sample_us : sof_sync_window_end_time(now, sample_us);
+  irq_sample_filter = init ? -1 : filter_type;
+
+  // windows are back to back, so normally the samples since the end of the last one belong to this one. but after a
+  // pause (calibration, low power sleep) they are stale
+  if (init || now - last_window_end_us > sample_us + sampling_buffer_time_us) {
+    take_irq_stats(by_sensor, init);
+  }
+  // with FILTER_TYPE_SPRT, end the window as soon as a sensor changes its decision
+  while (time_us_64() < end_time && !irq_decision_changed) {
+    tight_loop_contents();
+  }
+  const bool decision_changed = irq_decision_changed;
+  take_irq_stats(by_sensor, init);
+
+  uint64_t last_sample_us = time_us_64();
+  last_window_end_us = last_sample_us;
+  if (!init) {
+    if (!decision_changed) {
+      sof_sync_record_window_end(last_sample_us);
+    }
+    // every sensor runs at its own rate, so count complete rounds over all of them
+    count_t rounds = UINT32_MAX;
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      rounds = MIN(rounds, by_sensor[i].get_total_count());
+    }
+    touch_sample_count += rounds;
+  }
+  return last_sample_us;
 }
 
 #endif  // TOUCH_POLLING_TYPE
 
+// measure the untouched value of every sensor
+static void calibrate_touch_sensors() {
+  blink_interval_t blink = BLINK_SENSORS_CALIBRATING;
+  queue_add_blocking(&q_blink_interval, &blink);
+  // the noise of a sample depends on how many measurements it sums
+  apply_touch_accum_shift();
+  // in parts, to see how much the baseline drifts
+  static std::array<running_stats, num_touch_sensors> chunks[calibration_chunks];
+  uint64_t chunk_us = MAX(threshold_sampling_duration_us, 2 * sampling_buffer_time_us) / calibration_chunks;
+  for (uint c = 0; c < calibration_chunks; c++) {
+    sample_touch_inputs_for_us(chunks[c], chunk_us, /*init=*/true);
+  }
+  calibrate_from_chunks(chunks);
+  blink = BLINK_SENSORS_OK;
+  queue_add_blocking(&q_blink_interval, &blink);
+}
+
+// some sensor is close to its threshold (on either side), so a press or release may be about to happen
+static bool __time_critical_func(sensors_near_threshold)() {
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    if (!sensor_is_healthy(i)) {
+      continue;
+    }
+    float margin = adaptive_window_margin * (touch_sensor_thresholds[i] - touch_sensor_baseline[i]);
+    if (fabsf(sensor_values[i] - touch_sensor_thresholds[i]) < margin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// drop to the shortest window as soon as something is happening, then grow back slowly while it's quiet
+static uint64_t __time_critical_func(next_window_duration_us)(uint64_t duration_us, bool activity) {
+  if (!adaptive_window_enabled) {
+    return sampling_duration_us;
+  }
+  uint64_t min_us = MAX(adaptive_window_min_us, 2 * sampling_buffer_time_us);
+  uint64_t max_us = MAX(adaptive_window_max_us, min_us);
+  if (activity) {
+    return min_us;
+  }
+  return MIN(MAX(duration_us + duration_us / 4, min_us), max_us);
+}
+
+// the queues to core0 only hold the latest frame, replace it if core0 hasn't taken it yet. core0 can take the old
+// frame between the two calls, so neither of them may block
+template <typename T>
+static inline void __time_critical_func(publish_latest)(queue_t* q, const T& frame) {
+  T dummy;
+  queue_try_remove(q, &dummy);
+  queue_try_add(q, &frame);
+}
+
+static void __time_critical_func(publish_touchpad_stats)(const std::array<running_stats, num_touch_sensors>& by_sensor,
+                                                        uint64_t timestamp_us, uint32_t active_buttons) {
+  static touchpad_stats_t frame;
+  frame.timestamp_us = timestamp_us;
+  frame.active_buttons = active_buttons;
+  frame.active_sensors = 0;
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    frame.active_sensors |= (uint32_t)sensor_currently_active[i] << i;
+    float mean = by_sensor[i].get_total_count() ? by_sensor[i].get_mean_float() : 0;
+    frame.mean_fp[i] = (uint16_t)MIN(mean * (1 << touchpad_stats_mean_fraction_bits) + 0.5f, (float)UINT16_MAX);
+  }
+  publish_latest(&q_touchpad_stats, frame);
+
+  if (touchpad_stats_extended_enabled) {
+    static touchpad_stats_extended_t extended;
+    extended.timestamp_us = timestamp_us;
+    memcpy(extended.filtered_value, sensor_values, sizeof(extended.filtered_value));
+    extended.common_mode_value = common_mode_value;
+    extended.window_duration_us = window_duration_us;
+    for (uint i = 0; i < num_touch_sensors; i++) {
+      const kalman_tracker& kalman = by_sensor[i].kalman;
+      extended.tracked_baseline[i] =
+          filter_type == FILTER_TYPE_KALMAN && kalman.has_baseline() ? kalman.get_baseline() : touch_sensor_baseline[i];
+    }
+    publish_latest(&q_touchpad_stats_extended, extended);
+  }
+}
+
 void __time_critical_func(run_touch_sensor_thread)() {
   sleep_ms(250);
   blink_interval_t blink = BLINK_SENSORS_INIT;
@@ -163,47 +465,79 @@ void __time_critical_func(run_touch_sensor_thread)() {
   init_touch_sensors();
 
   IF_SERIAL_LOG(printf("pre-sample threshold values for all touch sensors\n"));
-  blink = BLINK_SENSORS_CALIBRATING;
-  queue_add_blocking(&q_blink_interval, &blink);
-  touchpad_stats_t stats = sample_touch_inputs_for_us(threshold_sampling_duration_us, /*init=*/true);
-  for (uint i = 0; i < num_touch_sensors; i++) {
-    touch_sensor_baseline[i] = stats.by_sensor[i].get_mean_float();
-    switch (threshold_type) {
-      case THRESHOLD_TYPE_FACTOR:
-        touch_sensor_thresholds[i] = uint16_t(stats.by_sensor[i].get_mean_float() * threshold_factor);
-        break;
-      case THRESHOLD_TYPE_VALUE:
-        touch_sensor_thresholds[i] = uint16_t(stats.by_sensor[i].get_mean_float() + threshold_value);
-        break;
-      default:
-        break;
-    }
-  }
-
+  calibrate_touch_sensors();
   IF_SERIAL_LOG(printf("begin reading all 8 PIO touch values\n"));
-  blink = BLINK_SENSORS_OK;
-  queue_add_blocking(&q_blink_interval, &blink);
+
+  // too big for core1's stack
+  static sliding_window window;
+  // what gets published, merged from the sub-windows in place
+  static std::array<running_stats, num_touch_sensors> by_sensor;
+  uint64_t duration_us = sampling_duration_us;
+  uint32_t prev_active_buttons = 0;
+  scan_mode_t scan_mode = SCAN_MODE_FULL;
   while (true) {
+    scan_mode_t new_scan_mode;
+    while (queue_try_remove(&q_scan_mode, &new_scan_mode)) {
+      scan_mode = new_scan_mode;
+    }
+    const bool low_power = scan_mode == SCAN_MODE_LOW_POWER && low_power_scan_enabled;
+
+    if (touch_recalibration_requested) {
+      calibrate_touch_sensors();
+      // the old sub-windows were measured against the old thresholds, and the SPRT and kalman states may have been
+      // seeded while the pad was pressed
+      window.reset();
+      touch_recalibration_requested = false;
+    }
+
     // update touch thresholds, just in case configured sensitivity has changed
-    for (uint i = 0; i < num_touch_sensors; i++) {
-      touch_sensor_baseline[i] = stats.by_sensor[i].get_mean_float();
-      switch (threshold_type) {
-        case THRESHOLD_TYPE_FACTOR:
-          touch_sensor_thresholds[i] = uint16_t(stats.by_sensor[i].get_mean_float() * threshold_factor);
-          break;
-        case THRESHOLD_TYPE_VALUE:
-          touch_sensor_thresholds[i] = uint16_t(stats.by_sensor[i].get_mean_float() + threshold_value);
-          break;
-        default:
-          break;
-      }
+    update_touch_thresholds();
+
+    window_duration_us = duration_us;
+
+    // split the window into sub-windows, but keep publishing stats over the whole window
+    uint num_subwindows = sliding_window::num_subwindows(duration_us);
+    if (low_power) {
+      // there is a long gap between scans, so each one has to be a whole window
+      num_subwindows = 1;
     }
+    window.resize(num_subwindows);
 
-    touchpad_stats_t stats = sample_touch_inputs_for_us(sampling_duration_us);
-    if (queue_is_full(&q_touchpad_stats)) {
-      touchpad_stats_t dummy;
-      queue_remove_blocking(&q_touchpad_stats, &dummy);
+    uint64_t window_start_us = time_us_64();
+    std::array<running_stats, num_touch_sensors>& subwindow = window.next_subwindow();
+    // the buffer is left out once per window, not once per sub-window
+    uint64_t timestamp_us =
+        sample_touch_inputs_for_us(subwindow, (duration_us - sampling_buffer_time_us) / num_subwindows);
+    update_sensor_health(subwindow);
+    window.commit();
+    window.merged(by_sensor, touch_sensor_thresholds);
+
+    uint32_t active_buttons = update_touch_decisions(by_sensor, timestamp_us);
+
+    uint64_t next_duration_us =
+        next_window_duration_us(duration_us, active_buttons != prev_active_buttons || sensors_near_threshold());
+    if (next_duration_us < duration_us) {
+      // the older (longer) sub-windows would hide what just changed
+      window.clear();
+    }
+    duration_us = next_duration_us;
+    prev_active_buttons = active_buttons;
+    update_sensor_counters(subwindow, timestamp_us);
+    bench_add_window(subwindow, window_start_us, timestamp_us);
+    publish_touchpad_stats(by_sensor, timestamp_us, active_buttons);
+
+    if (low_power) {
+      // sleep until the next scan, or until core0 changes the scan mode (adding to the queue wakes us up)
+      absolute_time_t next_scan = make_timeout_time_us(low_power_scan_interval_us);
+#if TOUCH_POLLING_TYPE == TOUCH_POLLING_IRQ
+      // the state machines stall once their FIFOs are full, instead of waking us up for every sample
+      set_touch_irqs_enabled(false);
+#endif
+      while (queue_is_empty(&q_scan_mode) && !best_effort_wfe_or_timeout(next_scan)) {
+      }
+#if TOUCH_POLLING_TYPE == TOUCH_POLLING_IRQ
+      set_touch_irqs_enabled(true);
+#endif
     }
-    queue_add_blocking(&q_touchpad_stats, &stats);
   }
 }
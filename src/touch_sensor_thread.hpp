@@ -5,12 +5,50 @@
 
 extern uint16_t touch_sensor_thresholds[num_touch_sensors];
 extern float touch_sensor_baseline[num_touch_sensors];
+// stddev of single samples while untouched, measured with the baseline
+extern float touch_sensor_noise[num_touch_sensors];
+// per-sample variance of the baseline's random walk (slow drift), measured with the baseline
+extern float touch_sensor_drift[num_touch_sensors];
 
 // for deriving the sampling rate
 extern volatile uint32_t touch_sample_count;
+// length of the current sampling window, differs from sampling_duration_us when adaptive_window_enabled
+extern volatile uint32_t window_duration_us;
 
+// set from core0 to re-measure the baseline of all sensors, core1 clears it when done
+extern volatile bool touch_recalibration_requested;
+
+// set from core0 while something is reading touchpad_stats_extended_t frames (teleplot, the vendor stream)
+extern volatile bool touchpad_stats_extended_enabled;
+
+// fraction bits of touchpad_stats_t::mean_fp, raw values are at most 12 bits so this still fits in 16
+constexpr uint touchpad_stats_mean_fraction_bits = 4;
+
+// what core1 sends core0 after every window (q_touchpad_stats), kept small because it's copied through the queue
 struct touchpad_stats_t {
-  const std::array<running_stats, num_touch_sensors> by_sensor;
+  // time of the last sample in the window
+  uint64_t timestamp_us;
+  // decided on core1 (see touch_decision.hpp), bit (1 << game_button) is set for every active button
+  uint32_t active_buttons;
+  // bit (1 << i) is set for every sensor that is above its threshold
+  uint32_t active_sensors;
+  // mean raw value of each sensor over the window, fixed point (see touchpad_stats_mean_fraction_bits)
+  uint16_t mean_fp[num_touch_sensors];
+
+  inline float get_mean(uint i) const { return mean_fp[i] * (1.0f / (1 << touchpad_stats_mean_fraction_bits)); }
+  inline bool sensor_is_active(uint i) const { return active_sensors & (1u << i); }
+};
+static_assert(num_touch_sensors <= 32, "touchpad_stats_t::active_sensors has one bit per sensor");
+
+// diagnostics for the same window, only sent (q_touchpad_stats_extended) while touchpad_stats_extended_enabled
+struct touchpad_stats_extended_t {
+  uint64_t timestamp_us;
+  // see touch_decision.hpp
+  float filtered_value[num_touch_sensors];
+  float common_mode_value;
+  uint32_t window_duration_us;
+  // the baseline FILTER_TYPE_KALMAN tracks under the touch signal, else the calibrated one
+  float tracked_baseline[num_touch_sensors];
 };
 
 // constexpr float threshold_factor = 1.5;
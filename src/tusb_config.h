@@ -91,6 +91,7 @@
 // Vendor FIFO size of TX and RX
 // If not configured vendor endpoints will not be buffered
 #define CFG_TUD_VENDOR_RX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 64)
-#define CFG_TUD_VENDOR_TX_BUFSIZE (TUD_OPT_HIGH_SPEED ? 512 : 64)
+// big enough for a whole sensor frame, see vendor_protocol.hpp
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
 
 
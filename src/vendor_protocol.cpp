@@ -0,0 +1,202 @@
+#include "tusb.h"
+
+#include "multicore_ipc.h"
+#include "sensor_health.hpp"
+#include "serial_config_console.hpp"
+#include "touch_hid_tasks.hpp"
+#include "touch_sensor_thread.hpp"
+#include "vendor_protocol.hpp"
+
+static_assert(sizeof(vendor_frame_header) + num_touch_sensors * sizeof(vendor_frame_sensor) <= CFG_TUD_VENDOR_TX_BUFSIZE,
+              "frame does not fit in the vendor TX buffer");
+
+static bool stream_enabled = false;
+static uint32_t stream_interval_us = 0;
+static uint64_t last_stream_us = 0;
+static uint32_t last_streamed_frame = 0;
+
+// incoming bytes, until a whole packet is there
+static uint8_t rx_buf[sizeof(vendor_packet_header) + VENDOR_MAX_PAYLOAD];
+static uint32_t rx_len = 0;
+
+// sends one packet, or nothing if it doesn't fit in the TX buffer right now
+static bool send_packet(uint8_t command, uint8_t seq, const void* payload, uint16_t length) {
+  if (tud_vendor_write_available() < sizeof(vendor_packet_header) + length) {
+    return false;
+  }
+  vendor_packet_header header = {command, seq, length};
+  tud_vendor_write(&header, sizeof(header));
+  tud_vendor_write(payload, length);
+  tud_vendor_flush();
+  return true;
+}
+
+static void send_status(uint8_t command, uint8_t seq, vendor_status status) {
+  vendor_status_response response = {status};
+  send_packet(command | VENDOR_RESPONSE_BIT, seq, &response, sizeof(response));
+}
+
+static bool send_frame(uint8_t seq) {
+  static uint8_t buf[sizeof(vendor_frame_header) + num_touch_sensors * sizeof(vendor_frame_sensor)];
+  vendor_frame_header* header = (vendor_frame_header*)buf;
+  header->timestamp_us = stats.timestamp_us;
+  header->active_buttons = stats.active_buttons;
+  header->num_sensors = num_touch_sensors;
+  vendor_frame_sensor* sensors = (vendor_frame_sensor*)(buf + sizeof(vendor_frame_header));
+  for (uint i = 0; i < num_touch_sensors; i++) {
+    sensors[i].mean = stats.get_mean(i);
+    // only streaming turns on the extended frames, a single GET_FRAME gets the mean
+    sensors[i].filtered_value = touchpad_stats_extended_enabled ? stats_extended.filtered_value[i] : stats.get_mean(i);
+    sensors[i].baseline = touch_sensor_baseline[i];
+    sensors[i].threshold = touch_sensor_thresholds[i];
+    sensors[i].health_faults = sensor_health_faults[i];
+    sensors[i].active = stats.sensor_is_active(i);
+  }
+  return send_packet(VENDOR_CMD_GET_FRAME | VENDOR_RESPONSE_BIT, seq, buf, sizeof(buf));
+}
+
+static vendor_config_type config_type(const config_console_value& v) {
+  if (v.value_float) {
+    return VENDOR_CONFIG_FLOAT;
+  } else if (v.value_uint64_t) {
+    return VENDOR_CONFIG_UINT64;
+  } else if (v.value_int) {
+    return VENDOR_CONFIG_INT;
+  }
+  return VENDOR_CONFIG_BOOL;
+}
+
+// find the config value for a request, or send an error and return nullptr
+static const config_console_value* lookup_config(uint8_t command, uint8_t seq, uint16_t index, uint16_t element) {
+  if (index >= num_config_values() || element >= get_config_value(index).count) {
+    send_status(command | VENDOR_RESPONSE_BIT, seq, VENDOR_STATUS_BAD_INDEX);
+    return nullptr;
+  }
+  return &get_config_value(index);
+}
+
+static void handle_packet(const vendor_packet_header& header, const uint8_t* payload) {
+  const uint8_t cmd = header.command;
+  const uint8_t response_cmd = cmd | VENDOR_RESPONSE_BIT;
+
+  // clang-format off
+  #define EXPECT_LENGTH(n) if (header.length != (n)) { send_status(response_cmd, header.seq, VENDOR_STATUS_BAD_LENGTH); return; }
+  // clang-format on
+
+  switch (cmd) {
+    case VENDOR_CMD_PING: {
+      vendor_ping_response response = {VENDOR_PROTOCOL_VERSION, num_touch_sensors, (uint16_t)num_config_values()};
+      send_packet(response_cmd, header.seq, &response, sizeof(response));
+      break;
+    }
+    case VENDOR_CMD_GET_FRAME:
+      send_frame(header.seq);
+      break;
+    case VENDOR_CMD_STREAM: {
+      EXPECT_LENGTH(sizeof(vendor_stream_request));
+      vendor_stream_request request;
+      memcpy(&request, payload, sizeof(request));
+      stream_enabled = request.enabled;
+      stream_interval_us = request.interval_us;
+      send_status(response_cmd, header.seq, VENDOR_STATUS_OK);
+      break;
+    }
+    case VENDOR_CMD_CONFIG_INFO: {
+      EXPECT_LENGTH(sizeof(vendor_config_index));
+      vendor_config_index request;
+      memcpy(&request, payload, sizeof(request));
+      const config_console_value* v = lookup_config(cmd, header.seq, request.index, 0);
+      if (!v) {
+        return;
+      }
+      uint8_t buf[sizeof(vendor_config_info_response) + VENDOR_MAX_PAYLOAD];
+      vendor_config_info_response response = {config_type(*v), (uint16_t)v->count};
+      memcpy(buf, &response, sizeof(response));
+      uint16_t name_len = MIN(v->name.size(), VENDOR_MAX_PAYLOAD);
+      memcpy(buf + sizeof(response), v->name.data(), name_len);
+      send_packet(response_cmd, header.seq, buf, sizeof(response) + name_len);
+      break;
+    }
+    case VENDOR_CMD_CONFIG_GET: {
+      EXPECT_LENGTH(sizeof(vendor_config_index));
+      vendor_config_index request;
+      memcpy(&request, payload, sizeof(request));
+      const config_console_value* v = lookup_config(cmd, header.seq, request.index, request.element);
+      if (!v) {
+        return;
+      }
+      vendor_config_value response = {request.index, request.element, 0};
+      v->write_to_raw(&response.raw_value, request.element);
+      send_packet(response_cmd, header.seq, &response, sizeof(response));
+      break;
+    }
+    case VENDOR_CMD_CONFIG_SET: {
+      EXPECT_LENGTH(sizeof(vendor_config_value));
+      vendor_config_value request;
+      memcpy(&request, payload, sizeof(request));
+      const config_console_value* v = lookup_config(cmd, header.seq, request.index, request.element);
+      if (!v) {
+        return;
+      }
+      v->read_from_raw(&request.raw_value, request.element);
+      send_status(response_cmd, header.seq, VENDOR_STATUS_OK);
+      break;
+    }
+    case VENDOR_CMD_CONFIG_SAVE:
+      send_status(response_cmd, header.seq, write_config_to_flash() ? VENDOR_STATUS_OK : VENDOR_STATUS_FAILED);
+      break;
+    case VENDOR_CMD_CALIBRATE:
+      touch_recalibration_requested = true;
+      send_status(response_cmd, header.seq, VENDOR_STATUS_OK);
+      break;
+    default:
+      send_status(response_cmd, header.seq, VENDOR_STATUS_UNKNOWN_COMMAND);
+      break;
+  }
+  #undef EXPECT_LENGTH
+}
+
+void vendor_protocol_task() {
+  if (!tud_mounted()) {
+    stream_enabled = false;
+    rx_len = 0;
+    return;
+  }
+
+  // read everything that's there first, one transfer can carry several packets
+  while (tud_vendor_available() && rx_len < sizeof(rx_buf)) {
+    rx_len += tud_vendor_read(rx_buf + rx_len, sizeof(rx_buf) - rx_len);
+  }
+
+  // then handle every complete packet
+  while (rx_len >= sizeof(vendor_packet_header)) {
+    vendor_packet_header header;
+    memcpy(&header, rx_buf, sizeof(header));
+    if (header.length > VENDOR_MAX_PAYLOAD) {
+      // out of sync, drop everything and start over
+      send_status(header.command | VENDOR_RESPONSE_BIT, header.seq, VENDOR_STATUS_BAD_LENGTH);
+      rx_len = 0;
+      break;
+    }
+    uint32_t packet_len = sizeof(header) + header.length;
+    if (rx_len < packet_len) {
+      break;
+    }
+    handle_packet(header, rx_buf + sizeof(header));
+    memmove(rx_buf, rx_buf + packet_len, rx_len - packet_len);
+    rx_len -= packet_len;
+  }
+
+  if (stream_enabled && touchpad_stats_frame_count != last_streamed_frame &&
+      time_us_64() - last_stream_us >= stream_interval_us) {
+    // if the host isn't keeping up, just skip this frame
+    if (send_frame(0)) {
+      last_streamed_frame = touchpad_stats_frame_count;
+      last_stream_us = time_us_64();
+    }
+  }
+}
+
+bool vendor_protocol_streaming() {
+  return stream_enabled;
+}
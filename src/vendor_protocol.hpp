@@ -0,0 +1,110 @@
+#pragma once
+#include "pico/stdlib.h"
+
+/**
+ * binary protocol on the WebUSB vendor interface, for telemetry and config. see tools/webusb_client.py for a host
+ * side implementation.
+ *
+ * every packet (both directions) starts with a vendor_packet_header, followed by `length` bytes of payload. all
+ * values are little endian. responses echo the command with VENDOR_RESPONSE_BIT set, and the seq of the request.
+ * streamed frames are sent as VENDOR_CMD_GET_FRAME responses with seq 0.
+ */
+
+#define VENDOR_PROTOCOL_VERSION 1
+#define VENDOR_RESPONSE_BIT 0x80
+#define VENDOR_MAX_PAYLOAD 60
+
+enum vendor_command : uint8_t {
+  // -> {}, <- vendor_ping_response
+  VENDOR_CMD_PING = 0x01,
+  // -> {}, <- vendor_frame_header + num_sensors * vendor_frame_sensor
+  VENDOR_CMD_GET_FRAME = 0x02,
+  // -> vendor_stream_request, <- vendor_status_response
+  VENDOR_CMD_STREAM = 0x03,
+  // -> vendor_config_index, <- vendor_config_info_response + name (not null terminated)
+  VENDOR_CMD_CONFIG_INFO = 0x10,
+  // -> vendor_config_index, <- vendor_config_value
+  VENDOR_CMD_CONFIG_GET = 0x11,
+  // -> vendor_config_value, <- vendor_status_response
+  VENDOR_CMD_CONFIG_SET = 0x12,
+  // -> {}, <- vendor_status_response
+  VENDOR_CMD_CONFIG_SAVE = 0x13,
+  // re-measure the baseline of all sensors (don't touch the pad). -> {}, <- vendor_status_response
+  VENDOR_CMD_CALIBRATE = 0x20,
+};
+
+enum vendor_status : uint8_t {
+  VENDOR_STATUS_OK = 0,
+  VENDOR_STATUS_UNKNOWN_COMMAND = 1,
+  VENDOR_STATUS_BAD_LENGTH = 2,
+  VENDOR_STATUS_BAD_INDEX = 3,
+  VENDOR_STATUS_FAILED = 4,
+};
+
+// same order as the config_console_value pointers
+enum vendor_config_type : uint8_t {
+  VENDOR_CONFIG_FLOAT = 0,
+  VENDOR_CONFIG_UINT64 = 1,
+  VENDOR_CONFIG_INT = 2,
+  VENDOR_CONFIG_BOOL = 3,
+};
+
+struct __attribute__((packed)) vendor_packet_header {
+  uint8_t command;
+  uint8_t seq;
+  uint16_t length;
+};
+
+struct __attribute__((packed)) vendor_status_response {
+  uint8_t status;
+};
+
+struct __attribute__((packed)) vendor_ping_response {
+  uint16_t protocol_version;
+  uint8_t num_sensors;
+  uint16_t num_config_values;
+};
+
+struct __attribute__((packed)) vendor_stream_request {
+  uint8_t enabled;
+  // minimum time between streamed frames, 0 sends every frame (as long as the USB buffer has room)
+  uint32_t interval_us;
+};
+
+struct __attribute__((packed)) vendor_frame_header {
+  uint64_t timestamp_us;
+  uint32_t active_buttons;
+  uint8_t num_sensors;
+};
+
+struct __attribute__((packed)) vendor_frame_sensor {
+  float mean;
+  // after common mode rejection and crosstalk compensation
+  float filtered_value;
+  float baseline;
+  uint16_t threshold;
+  uint8_t health_faults;
+  uint8_t active;
+};
+
+struct __attribute__((packed)) vendor_config_index {
+  uint16_t index;
+  // element of a per-sensor array
+  uint16_t element;
+};
+
+struct __attribute__((packed)) vendor_config_info_response {
+  uint8_t type;
+  uint16_t count;
+};
+
+struct __attribute__((packed)) vendor_config_value {
+  uint16_t index;
+  uint16_t element;
+  // same layout as the flash config: the value in the first bytes of a 64 bit slot
+  uint64_t raw_value;
+};
+
+void vendor_protocol_task();
+// the host asked for a stream of frames
+bool vendor_protocol_streaming();
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+small host client for the binary protocol on the WebUSB vendor interface (see src/vendor_protocol.hpp).
+
+needs pyusb (`pip install pyusb`), and on linux a udev rule or root to access the device.
+
+    ./tools/webusb_client.py ping
+    ./tools/webusb_client.py frame
+    ./tools/webusb_client.py stream [INTERVAL_US]
+    ./tools/webusb_client.py list
+    ./tools/webusb_client.py get NAME[I]
+    ./tools/webusb_client.py set NAME[I] VALUE
+    ./tools/webusb_client.py save
+    ./tools/webusb_client.py calibrate
+"""
+import re
+import struct
+import sys
+
+import usb.core
+import usb.util
+
+VID = 0xCAFE
+PID = 0x4016
+INTERFACE = 5
+EP_OUT = 0x06
+EP_IN = 0x86
+
+RESPONSE_BIT = 0x80
+CMD_PING = 0x01
+CMD_GET_FRAME = 0x02
+CMD_STREAM = 0x03
+CMD_CONFIG_INFO = 0x10
+CMD_CONFIG_GET = 0x11
+CMD_CONFIG_SET = 0x12
+CMD_CONFIG_SAVE = 0x13
+CMD_CALIBRATE = 0x20
+
+STATUS_NAMES = ["ok", "unknown command", "bad length", "bad index", "failed"]
+CONFIG_FORMATS = {0: "<f", 1: "<Q", 2: "<i", 3: "<?"}
+CONFIG_PARSERS = {0: float, 1: int, 2: int, 3: lambda s: s.lower() in ("1", "true", "on")}
+
+HEADER = struct.Struct("<BBH")
+FRAME_HEADER = struct.Struct("<QIB")
+FRAME_SENSOR = struct.Struct("<fffHBB")
+
+
+class Pad:
+    def __init__(self):
+        self.dev = usb.core.find(idVendor=VID, idProduct=PID)
+        if self.dev is None:
+            sys.exit("no dance pad found (%04x:%04x)" % (VID, PID))
+        usb.util.claim_interface(self.dev, INTERFACE)
+        self.seq = 0
+        self.rx = b""
+
+    def send(self, cmd, payload=b""):
+        self.seq = (self.seq + 1) & 0xFF or 1
+        self.dev.write(EP_OUT, HEADER.pack(cmd, self.seq, len(payload)) + payload)
+        return self.seq
+
+    def read_packet(self, timeout=1000):
+        while True:
+            if len(self.rx) >= HEADER.size:
+                cmd, seq, length = HEADER.unpack_from(self.rx)
+                if len(self.rx) >= HEADER.size + length:
+                    payload = self.rx[HEADER.size:HEADER.size + length]
+                    self.rx = self.rx[HEADER.size + length:]
+                    return cmd, seq, payload
+            self.rx += bytes(self.dev.read(EP_IN, 512, timeout))
+
+    def request(self, cmd, payload=b""):
+        seq = self.send(cmd, payload)
+        while True:
+            rcmd, rseq, rpayload = self.read_packet()
+            # skip streamed frames and stale responses
+            if rcmd == cmd | RESPONSE_BIT and rseq == seq:
+                return rpayload
+
+    def request_status(self, cmd, payload=b""):
+        status = self.request(cmd, payload)[0]
+        if status != 0:
+            sys.exit("error: " + STATUS_NAMES[status] if status < len(STATUS_NAMES) else str(status))
+
+    def ping(self):
+        return struct.unpack("<HBH", self.request(CMD_PING))
+
+    def config_info(self, index):
+        payload = self.request(CMD_CONFIG_INFO, struct.pack("<HH", index, 0))
+        if len(payload) == 1:
+            sys.exit("error: " + STATUS_NAMES[payload[0]])
+        type_, count = struct.unpack_from("<BH", payload)
+        return payload[3:].decode(), type_, count
+
+    def config_table(self):
+        _, _, num_config_values = self.ping()
+        return [self.config_info(i) for i in range(num_config_values)]
+
+    def config_get(self, index, element, type_):
+        payload = self.request(CMD_CONFIG_GET, struct.pack("<HH", index, element))
+        raw = payload[4:]
+        return struct.unpack_from(CONFIG_FORMATS[type_], raw)[0]
+
+    def config_set(self, index, element, type_, value):
+        raw = struct.pack(CONFIG_FORMATS[type_], value).ljust(8, b"\0")
+        self.request_status(CMD_CONFIG_SET, struct.pack("<HH", index, element) + raw)
+
+
+def parse_frame(payload):
+    timestamp_us, active_buttons, num_sensors = FRAME_HEADER.unpack_from(payload)
+    sensors = [FRAME_SENSOR.unpack_from(payload, FRAME_HEADER.size + i * FRAME_SENSOR.size) for i in range(num_sensors)]
+    return timestamp_us, active_buttons, sensors
+
+
+def print_frame(payload):
+    timestamp_us, active_buttons, sensors = parse_frame(payload)
+    print("t=%d us buttons=0x%04x" % (timestamp_us, active_buttons))
+    for i, (mean, filtered, baseline, threshold, faults, active) in enumerate(sensors):
+        print("  %d: mean=%8.1f filtered=%8.1f baseline=%8.1f threshold=%5d faults=0x%02x %s"
+              % (i, mean, filtered, baseline, threshold, faults, "ACTIVE" if active else ""))
+
+
+def find_config(table, spec):
+    m = re.fullmatch(r"(\w+)(?:\[(\d+)\])?", spec)
+    if not m:
+        sys.exit("bad config name: " + spec)
+    name, element = m.group(1), m.group(2)
+    for index, (n, type_, count) in enumerate(table):
+        if n == name:
+            elements = [int(element)] if element is not None else list(range(count))
+            return index, type_, elements
+    sys.exit("unknown config value: " + name)
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.exit(__doc__)
+    pad = Pad()
+    cmd = argv[1]
+    if cmd == "ping":
+        version, num_sensors, num_config_values = pad.ping()
+        print("protocol version %d, %d sensors, %d config values" % (version, num_sensors, num_config_values))
+    elif cmd == "frame":
+        print_frame(pad.request(CMD_GET_FRAME))
+    elif cmd == "stream":
+        interval_us = int(argv[2]) if len(argv) > 2 else 100 * 1000
+        pad.request_status(CMD_STREAM, struct.pack("<BI", 1, interval_us))
+        try:
+            while True:
+                rcmd, _, payload = pad.read_packet(timeout=5000)
+                if rcmd == CMD_GET_FRAME | RESPONSE_BIT:
+                    print_frame(payload)
+        except KeyboardInterrupt:
+            pad.request_status(CMD_STREAM, struct.pack("<BI", 0, 0))
+    elif cmd == "list":
+        for index, (name, type_, count) in enumerate(pad.config_table()):
+            values = [pad.config_get(index, j, type_) for j in range(count)]
+            print("%s = %s" % (name, values[0] if count == 1 else values))
+    elif cmd == "get" and len(argv) == 3:
+        index, type_, elements = find_config(pad.config_table(), argv[2])
+        for j in elements:
+            print(pad.config_get(index, j, type_))
+    elif cmd == "set" and len(argv) == 4:
+        index, type_, elements = find_config(pad.config_table(), argv[2])
+        for j in elements:
+            pad.config_set(index, j, type_, CONFIG_PARSERS[type_](argv[3]))
+    elif cmd == "save":
+        pad.request_status(CMD_CONFIG_SAVE)
+    elif cmd == "calibrate":
+        pad.request_status(CMD_CALIBRATE)
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main(sys.argv)